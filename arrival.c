@@ -0,0 +1,189 @@
+/* ******************************************************************
+   Layer 5 arrival processes for the emulator.  See arrival.h.
+   All randomness comes from jimsrand() so runs stay reproducible.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "emulator.h"
+#include "arrival.h"
+
+static const char *modelnames[] = {
+  "uniform", "poisson", "onoff", "pareto", "constant", "trace"
+};
+
+/* uniform on (0,1]: safe to take the log of or divide by */
+static double openrand(void)
+{
+  double u = 1.0 - jimsrand();
+
+  if (u <= 0.0)
+    u = 1e-12;
+  return u;
+}
+
+static double exprand(double mean)
+{
+  return -mean * log(openrand());
+}
+
+int arrival_parse(struct arrival *a, const char *spec)
+{
+  const char *arg = strchr(spec, ':');
+  size_t len = arg ? (size_t)(arg - spec) : strlen(spec);
+  int m;
+
+  memset(a, 0, sizeof(*a));
+  for (m = 0; m <= ARR_TRACE; m++)
+    if (strlen(modelnames[m]) == len && strncmp(spec, modelnames[m], len) == 0)
+      break;
+  if (m > ARR_TRACE)
+    return -1;
+  a->model = m;
+  if (arg)
+    arg++;
+
+  switch (m) {
+  case ARR_ONOFF:
+    if (arg == NULL || sscanf(arg, "%lf,%lf", &a->on_mean, &a->off_mean) != 2 ||
+        a->on_mean <= 0.0 || a->off_mean < 0.0)
+      return -1;
+    break;
+  case ARR_PARETO:
+    if (arg == NULL || sscanf(arg, "%lf", &a->alpha) != 1 || a->alpha <= 1.0)
+      return -1;
+    break;
+  case ARR_TRACE:
+    if (arg == NULL || *arg == '\0')
+      return -1;
+    a->tracefile = strdup(arg);
+    break;
+  default:
+    if (arg != NULL)
+      return -1;
+  }
+  return 0;
+}
+
+/* time of the arrival following one at now, or -1 if there is none */
+static double draw(struct arrival *a, double now)
+{
+  double t, gap, xm;
+
+  switch (a->model) {
+  case ARR_POISSON:
+    return now + exprand(a->mean);
+
+  case ARR_ONOFF:
+    /* while ON the rate is raised so that the long-run mean gap is lambda */
+    gap = a->mean * a->on_mean / (a->on_mean + a->off_mean);
+    t = now + exprand(gap);
+    while (t > a->on_until) {
+      /* the ON period ended first: sit out an OFF period, then restart
+         the (memoryless) arrival clock at the start of the next ON */
+      t = a->on_until + exprand(a->off_mean);
+      a->on_until = t + exprand(a->on_mean);
+      t += exprand(gap);
+    }
+    return t;
+
+  case ARR_PARETO:
+    /* scale chosen so that the mean gap is lambda */
+    xm = a->mean * (a->alpha - 1.0) / a->alpha;
+    return now + xm / pow(openrand(), 1.0 / a->alpha);
+
+  case ARR_CONSTANT:
+    return now + a->mean;
+
+  case ARR_TRACE:
+    if (a->trace == NULL || fscanf(a->trace, "%lf", &t) != 1)
+      return -1.0;
+    return t < now ? now : t;
+
+  default:
+    return now + a->mean * jimsrand() * 2;  /* uniform on [0,2*lambda] */
+  }
+}
+
+static void schedule(struct arrival *a, double now)
+{
+  double t = draw(a, now);
+
+  if (t < 0.0) {
+    a->active = 0;
+    return;
+  }
+  a->next = t;
+  a->ngaps++;
+  a->gapsum += a->next - a->last;
+  a->gapsq += (a->next - a->last) * (a->next - a->last);
+}
+
+void arrival_start(struct arrival *a, double mean, double now)
+{
+  a->mean = mean;
+  a->active = 1;
+  a->last = now;
+  a->offered = a->dropped = a->delivered = a->ngaps = 0;
+  a->gapsum = a->gapsq = 0.0;
+  a->paused = 0;
+  a->blocked = 0.0;
+
+  if (a->model == ARR_ONOFF)
+    a->on_until = now + exprand(a->on_mean);
+  if (a->model == ARR_TRACE) {
+    if (a->trace != NULL)
+      fclose(a->trace);
+    a->trace = fopen(a->tracefile, "r");
+    if (a->trace == NULL) {
+      printf("unable to open arrival trace %s\n", a->tracefile);
+      exit(EXIT_FAILURE);
+    }
+  }
+  schedule(a, now);
+}
+
+void arrival_advance(struct arrival *a, double now)
+{
+  a->last = now;
+  schedule(a, now);
+}
+
+void arrival_pause(struct arrival *a, double now)
+{
+  if (a->paused)
+    return;
+  a->paused = 1;
+  a->pausedat = now;
+}
+
+void arrival_resume(struct arrival *a, double now)
+{
+  if (!a->paused)
+    return;
+  a->paused = 0;
+  a->blocked += now - a->pausedat;
+  if (a->next < now)
+    a->next = now;
+}
+
+const char *arrival_name(const struct arrival *a)
+{
+  return modelnames[a->model];
+}
+
+void arrival_report(const struct arrival *a, int AorB)
+{
+  int n = a->offered;
+  double mean = a->ngaps ? a->gapsum / a->ngaps : 0.0;
+  double var = a->ngaps ? a->gapsq / a->ngaps - mean * mean : 0.0;
+
+  printf("arrivals at %c (%s): offered %d, dropped due to full window %d (%.1f%%), delivered %d\n",
+         AorB == A ? 'A' : 'B', arrival_name(a), n, a->dropped,
+         n ? 100.0 * a->dropped / n : 0.0, a->delivered);
+  printf("    mean gap %f, gap coefficient of variation %f\n",
+         mean, mean > 0.0 && var > 0.0 ? sqrt(var) / mean : 0.0);
+  if (a->blocked > 0.0)
+    printf("    stopped by flow control for %f time units\n", a->blocked);
+}
@@ -0,0 +1,80 @@
+#ifndef ARRIVAL_H
+#define ARRIVAL_H
+
+#include <stdio.h>
+
+/* ******************************************************************
+   Layer 5 arrival processes.
+
+   Each message source keeps exactly one pending "next arrival" time;
+   the emulator main loop compares it with the head of the event list
+   instead of queueing a FROM_LAYER5 event per message.  The mean time
+   between messages is always the lambda entered at start-up; the model
+   only changes how the gaps are distributed.
+
+   Models (selected with --arrival=SPEC):
+     uniform            gaps uniform on [0, 2*lambda] (the original model)
+     poisson            exponential gaps
+     onoff:ON,OFF       exponential ON and OFF periods with means ON and
+                        OFF; Poisson arrivals while ON, none while OFF
+     pareto:ALPHA       Pareto gaps with shape ALPHA > 1 (heavy tailed)
+     constant           every gap is exactly lambda
+     trace:FILE         arrival times read from FILE, one per line
+**********************************************************************/
+
+#define ARR_UNIFORM  0
+#define ARR_POISSON  1
+#define ARR_ONOFF    2
+#define ARR_PARETO   3
+#define ARR_CONSTANT 4
+#define ARR_TRACE    5
+
+struct arrival {
+  int model;            /* one of the ARR_* codes */
+  double mean;          /* mean time between messages (lambda) */
+  double on_mean;       /* ON/OFF: mean length of an ON period */
+  double off_mean;      /* ON/OFF: mean length of an OFF period */
+  double on_until;      /* ON/OFF: end of the current ON period */
+  double alpha;         /* Pareto: shape */
+  char *tracefile;      /* trace: name of the file of arrival times */
+  FILE *trace;          /* trace: open file, read one line per arrival */
+
+  int active;           /* 0 once the source has nothing more to send */
+  float next;           /* time of the pending arrival (same precision */
+  float last;           /* as event times) and of the previous one */
+  unsigned long seq;    /* when the pending arrival was scheduled, in the
+                           emulator's event insertion order */
+  int paused;           /* layer 4 asked for no more messages for now */
+  double pausedat;
+
+  /* statistics */
+  int offered;          /* messages handed to layer 4 */
+  int dropped;          /* messages refused because the window was full */
+  int delivered;        /* messages delivered to the peer's layer 5 */
+  double blocked;       /* total time spent paused */
+  int ngaps;            /* number of gaps drawn */
+  double gapsum;        /* sum and sum of squares of the gaps */
+  double gapsq;
+};
+
+/* parse a model SPEC into a; returns 0 on success */
+extern int arrival_parse(struct arrival *a, const char *spec);
+
+/* reset a's state and statistics and draw its first arrival after now */
+extern void arrival_start(struct arrival *a, double mean, double now);
+
+/* the pending arrival at now happened: draw the one after it */
+extern void arrival_advance(struct arrival *a, double now);
+
+/* layer 4 stops or restarts the source at now.  A restarted source
+   delivers an arrival that fell due while it was paused straight away
+   and draws later gaps from then on. */
+extern void arrival_pause(struct arrival *a, double now);
+extern void arrival_resume(struct arrival *a, double now);
+
+/* print a's statistics, labelled with the entity that owns it */
+extern void arrival_report(const struct arrival *a, int AorB);
+
+extern const char *arrival_name(const struct arrival *a);
+
+#endif
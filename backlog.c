@@ -0,0 +1,98 @@
+/* ******************************************************************
+   Sender backlog shared by the protocols.  See backlog.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include "emulator.h"
+#include "protocol.h"
+#include "backlog.h"
+
+void backlog_create(struct backlog *b, const struct protoconf *conf)
+{
+  b->capacity = conf->backlog_capacity;
+  b->block = conf->backlog_block;
+  b->msgs = NULL;
+  b->times = NULL;
+  if (b->capacity > 0) {
+    b->msgs = malloc(b->capacity * sizeof(struct msg));
+    b->times = malloc(b->capacity * sizeof(double));
+    if (b->msgs == NULL || b->times == NULL) {
+      printf("memory allocation for backlog failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  backlog_reset(b);
+}
+
+void backlog_destroy(struct backlog *b)
+{
+  free(b->msgs);
+  free(b->times);
+}
+
+void backlog_reset(struct backlog *b)
+{
+  b->first = 0;
+  b->count = 0;
+  b->since = 0.0;
+  b->blocked = false;
+}
+
+/* add the time the backlog spent at its current length to the statistics */
+static void tick(struct backlog *b)
+{
+  double now = gettime();
+
+  backlog_area += b->count * (now - b->since);
+  b->since = now;
+}
+
+int backlog_put(struct backlog *b, struct msg message)
+{
+  int last;
+
+  if (b->count == b->capacity)
+    return -1;
+  tick(b);
+  last = (b->first + b->count) % b->capacity;
+  b->msgs[last] = message;
+  b->times[last] = gettime();
+  b->count++;
+  if (b->count > backlog_max)
+    backlog_max = b->count;
+  return 0;
+}
+
+int backlog_get(struct backlog *b, struct msg *message)
+{
+  double waited;
+
+  if (b->count == 0)
+    return -1;
+  tick(b);
+  waited = gettime() - b->times[b->first];
+  messages_queued++;
+  queue_delay += waited;
+  if (waited > queue_delay_max)
+    queue_delay_max = waited;
+  *message = b->msgs[b->first];
+  b->first = (b->first + 1) % b->capacity;
+  b->count--;
+  return 0;
+}
+
+void backlog_pressure(struct backlog *b, bool windowfull)
+{
+  if (b->block && !b->blocked && windowfull && b->count == b->capacity) {
+    if (TRACING(1))
+      printf("----A: window and backlog are full, stop layer 5\n");
+    b->blocked = true;
+    stoplayer5(A);
+  }
+  else if (b->blocked && (!windowfull || b->count < b->capacity)) {
+    if (TRACING(1))
+      printf("----A: room again, restart layer 5\n");
+    b->blocked = false;
+    startlayer5(A);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+/* ******************************************************************
+   Sender backlog shared by the protocols (--backlog).
+
+   Messages that arrive at A while the window is full wait in the
+   backlog, a circular queue of capacity entries; if that is full too
+   they are dropped, or with block layer 5 is told to stop until there
+   is room again.  A protocol embeds a struct backlog, offers it the
+   messages its window has no room for, takes them back as the window
+   moves, and calls backlog_pressure() after either.  The statistics
+   (messages_queued, queue_delay, backlog_max, ...) are kept here.
+
+   Include emulator.h and protocol.h first.
+**********************************************************************/
+
+#include <stdbool.h>
+
+struct backlog {
+  int capacity;
+  bool block;               /* stop layer 5 instead of dropping when full */
+  struct msg *msgs;         /* queued messages */
+  double *times;            /* when each queued message arrived */
+  int first, count;
+  double since;             /* when count last changed */
+  bool blocked;             /* layer 5 has been stopped */
+};
+
+/* set up from the options, allocating the queue; exits on failure */
+extern void backlog_create(struct backlog *b, const struct protoconf *conf);
+extern void backlog_destroy(struct backlog *b);
+
+/* empty the queue, for A_init */
+extern void backlog_reset(struct backlog *b);
+
+/* queue message; 0 if it was, -1 if the backlog is full */
+extern int backlog_put(struct backlog *b, struct msg message);
+
+/* take the oldest queued message; 0 if there was one, -1 if empty */
+extern int backlog_get(struct backlog *b, struct msg *message);
+
+/* stop layer 5 when neither the window (windowfull) nor the backlog has
+   room, and restart it when one has again */
+extern void backlog_pressure(struct backlog *b, bool windowfull);
+
+#endif
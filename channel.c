@@ -0,0 +1,339 @@
+/* ******************************************************************
+   Markov (Gilbert-Elliott) loss and corruption models for the
+   emulator's medium.  See channel.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "emulator.h"
+#include "channel.h"
+
+/* turn the transition probabilities in c->cumtrans into cumulative rows */
+static int cumulate(struct channel *c)
+{
+  int i, j;
+  double sum;
+
+  for (i = 0; i < c->nstates; i++) {
+    sum = 0.0;
+    for (j = 0; j < c->nstates; j++) {
+      if (c->cumtrans[i][j] < 0.0)
+        return -1;
+      sum += c->cumtrans[i][j];
+      c->cumtrans[i][j] = sum;
+    }
+    if (fabs(sum - 1.0) > 1e-6)
+      return -1;
+    c->cumtrans[i][c->nstates-1] = 1.0;
+  }
+  return 0;
+}
+
+static int readmarkov(struct channel *c, const char *file)
+{
+  FILE *f = fopen(file, "r");
+  char line[256], *p, *end, *hash;
+  double v[1 + CH_MAXSTATES * (CH_MAXSTATES + 2)];
+  int nv = 0, want = 1, n = 0, i, j;
+
+  if (f == NULL) {
+    printf("unable to open channel model %s\n", file);
+    return -1;
+  }
+  /* whitespace separated numbers, # starts a comment */
+  while (nv < want && fgets(line, sizeof(line), f) != NULL) {
+    if ((hash = strchr(line, '#')) != NULL)
+      *hash = '\0';
+    for (p = line; nv < want; p = end) {
+      v[nv] = strtod(p, &end);
+      if (end == p)
+        break;
+      if (nv++ == 0) {
+        n = (int)v[0];
+        if (n < 1 || n > CH_MAXSTATES) {
+          fclose(f);
+          return -1;
+        }
+        want = 1 + n * (n + 2);
+      }
+    }
+  }
+  fclose(f);
+  if (nv < want)
+    return -1;
+
+  c->nstates = n;
+  for (i = 0; i < n; i++) {
+    c->loss[i] = v[1 + i*(n+2)];
+    c->corrupt[i] = v[2 + i*(n+2)];
+    for (j = 0; j < n; j++)
+      c->cumtrans[i][j] = v[3 + i*(n+2) + j];
+  }
+  return 0;
+}
+
+#define TRACEMAGIC "CHTRACE1"
+#define TRACEREC   5        /* binary record: float delay, flags */
+
+/* map the trace named in SPEC (FILE[,loop][,scale=S]) */
+static int opentrace(struct channel *c, const char *spec)
+{
+  char *opt, *next;
+  struct stat st;
+  void *map;
+  int fd;
+
+  c->tracefile = strdup(spec);
+  c->scale = 1.0;
+  if ((opt = strchr(c->tracefile, ',')) != NULL)
+    *opt++ = '\0';
+  for (; opt != NULL; opt = next) {
+    if ((next = strchr(opt, ',')) != NULL)
+      *next++ = '\0';
+    if (strcmp(opt, "loop") == 0)
+      c->loop = 1;
+    else if (sscanf(opt, "scale=%lf", &c->scale) != 1 || c->scale < 0.0)
+      return -1;
+  }
+
+  if ((fd = open(c->tracefile, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    printf("unable to open channel trace %s\n", c->tracefile);
+    return -1;
+  }
+  map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("unable to map channel trace %s\n", c->tracefile);
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  c->map = map;
+  c->mapsize = st.st_size;
+  if (c->mapsize >= 8 && memcmp(c->map, TRACEMAGIC, 8) == 0) {
+    c->binary = 1;
+    c->start = 8;
+    if ((c->mapsize - 8) % TRACEREC != 0 || c->mapsize == 8)
+      return -1;
+  }
+  return 0;
+}
+
+/* read the record at c->pos; returns 0 at the end of the trace */
+static int nextrecord(struct channel *c)
+{
+  const char *line, *end;
+  char buf[128], *hash;
+  float f;
+  int n, lost, corrupt;
+  size_t len;
+
+  if (c->binary) {
+    if (c->pos + TRACEREC > c->mapsize)
+      return 0;
+    memcpy(&f, c->map + c->pos, sizeof(f));   /* little-endian hosts only */
+    c->delay = f;
+    c->tracelost = c->map[c->pos + 4] & 1;
+    c->tracecorrupt = (c->map[c->pos + 4] & 2) != 0;
+    c->pos += TRACEREC;
+    return 1;
+  }
+
+  while (c->pos < c->mapsize) {
+    line = (const char *)c->map + c->pos;
+    end = memchr(line, '\n', c->mapsize - c->pos);
+    len = end ? (size_t)(end - line) : c->mapsize - c->pos;
+    c->pos += len + (end != NULL);
+    if (len >= sizeof(buf))
+      len = sizeof(buf) - 1;
+    memcpy(buf, line, len);
+    buf[len] = '\0';
+    if ((hash = strchr(buf, '#')) != NULL)
+      *hash = '\0';
+    lost = corrupt = 0;
+    n = sscanf(buf, "%lf ,%d ,%d", &c->delay, &lost, &corrupt);
+    if (n >= 1) {
+      c->tracelost = lost != 0;
+      c->tracecorrupt = corrupt != 0;
+      return 1;
+    }
+    if (strspn(buf, " \t\r") != strlen(buf)) {
+      printf("bad line in channel trace %s\n", c->tracefile);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return 0;
+}
+
+/* move on to the next packet's record */
+static void tracestep(struct channel *c)
+{
+  if (nextrecord(c))
+    return;
+  if (c->loop) {
+    c->pos = c->start;
+    c->wraps++;
+    if (nextrecord(c))
+      return;
+  }
+  c->overrun++;         /* through, with the last delay */
+  c->tracelost = c->tracecorrupt = 0;
+}
+
+int channel_parse(struct channel *c, const char *spec)
+{
+  double p, r, lg, lb, cg = 0.0, cb = 0.0;
+  int n;
+
+  memset(c, 0, sizeof(*c));
+  if (strncmp(spec, "bernoulli:", 10) == 0) {
+    if (sscanf(spec + 10, "%lf,%lf", &lg, &cg) != 2)
+      return -1;
+    channel_bernoulli(c, lg, cg);
+    return 0;
+  }
+  if (strncmp(spec, "ge:", 3) == 0) {
+    n = sscanf(spec + 3, "%lf,%lf,%lf,%lf,%lf,%lf", &p, &r, &lg, &lb, &cg, &cb);
+    if (n != 4 && n != 6)
+      return -1;
+    strcpy(c->name, "gilbert-elliott");
+    c->nstates = 2;
+    c->loss[0] = lg;
+    c->loss[1] = lb;
+    c->corrupt[0] = cg;
+    c->corrupt[1] = cb;
+    c->cumtrans[0][0] = 1.0 - p;
+    c->cumtrans[0][1] = p;
+    c->cumtrans[1][0] = r;
+    c->cumtrans[1][1] = 1.0 - r;
+    return cumulate(c);
+  }
+  if (strncmp(spec, "trace:", 6) == 0) {
+    strcpy(c->name, "trace");
+    c->nstates = 1;
+    c->cumtrans[0][0] = 1.0;
+    return opentrace(c, spec + 6);
+  }
+  if (strncmp(spec, "markov:", 7) == 0) {
+    strcpy(c->name, "markov");
+    if (readmarkov(c, spec + 7) != 0)
+      return -1;
+    return cumulate(c);
+  }
+  return -1;
+}
+
+void channel_bernoulli(struct channel *c, double loss, double corrupt)
+{
+  strcpy(c->name, "bernoulli");
+  c->nstates = 1;
+  c->loss[0] = loss;
+  c->corrupt[0] = corrupt;
+  c->cumtrans[0][0] = 1.0;
+}
+
+void channel_start(struct channel *c)
+{
+  c->state = c->pktstate = 0;
+  c->packets = c->lost = c->corrupted = 0;
+  c->run = c->nbursts = c->maxburst = 0;
+  c->burstsum = 0;
+  memset(c->bursts, 0, sizeof(c->bursts));
+  memset(c->visits, 0, sizeof(c->visits));
+  c->pos = c->start;
+  c->delay = 0.0;
+  c->wraps = c->overrun = 0;
+}
+
+/* a run of losses just ended */
+static void endburst(struct channel *c)
+{
+  c->nbursts++;
+  c->burstsum += c->run;
+  if (c->run > c->maxburst)
+    c->maxburst = c->run;
+  c->bursts[c->run < CH_BURSTS ? c->run - 1 : CH_BURSTS - 1]++;
+  c->run = 0;
+}
+
+int channel_lose(struct channel *c)
+{
+  int s = c->state;
+  int lost;
+  double u;
+
+  c->pktstate = s;
+  c->packets++;
+  c->visits[s]++;
+  if (c->tracefile != NULL) {
+    tracestep(c);
+    lost = c->tracelost;
+  }
+  else
+    lost = jimsrand() < c->loss[s];
+
+  if (lost) {
+    c->lost++;
+    c->run++;
+  }
+  else if (c->run > 0)
+    endburst(c);
+
+  /* step the chain; the one-state model draws nothing so that it uses
+     the same random numbers as the original emulator */
+  if (c->nstates > 1) {
+    u = jimsrand();
+    for (s = 0; s < c->nstates - 1 && u >= c->cumtrans[c->state][s]; s++)
+      ;
+    c->state = s;
+  }
+  return lost;
+}
+
+int channel_corrupt(struct channel *c)
+{
+  if (c->tracefile != NULL ? c->tracecorrupt : jimsrand() < c->corrupt[c->pktstate]) {
+    c->corrupted++;
+    return 1;
+  }
+  return 0;
+}
+
+int channel_delay(const struct channel *c, double *delay)
+{
+  if (c->tracefile == NULL)
+    return 0;
+  *delay = c->delay * c->scale;
+  return 1;
+}
+
+void channel_report(struct channel *c, int AorB)
+{
+  int i;
+
+  if (c->run > 0)
+    endburst(c);
+  printf("channel %s (%s): %d packets, %d lost, %d corrupted\n",
+         AorB == A ? "A->B" : "B->A", c->name, c->packets, c->lost, c->corrupted);
+  if (c->tracefile != NULL)
+    printf("    trace %s (%s, delays x %g): started over %d times, %d packets after its end\n",
+           c->tracefile, c->binary ? "binary" : "csv", c->scale, c->wraps, c->overrun);
+  if (c->nbursts == 0)
+    return;
+  printf("    loss bursts: %d, mean length %.2f, longest %d; lengths:",
+         c->nbursts, (double)c->burstsum / c->nbursts, c->maxburst);
+  for (i = 0; i < CH_BURSTS; i++)
+    if (c->bursts[i])
+      printf(" %d%s:%d", i + 1, i == CH_BURSTS - 1 ? "+" : "", c->bursts[i]);
+  printf("\n");
+  if (c->nstates > 1) {
+    printf("    packets per state:");
+    for (i = 0; i < c->nstates; i++)
+      printf(" %d", c->visits[i]);
+    printf("\n");
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+/* ******************************************************************
+   Loss and corruption models for one direction of the medium.
+
+   A channel is a Markov chain over a few states, each with its own
+   loss and corruption probability.  The chain takes one step per packet
+   offered to the medium, so losses come in bursts whenever a state with
+   a high loss rate is sticky.  The original independent model is the
+   one-state case.
+
+   Models (selected with --channel, --channel-ab or --channel-ba):
+     bernoulli:LOSS,CORRUPT        independent losses (one state)
+     ge:P,R,LG,LB[,CG,CB]          Gilbert-Elliott: P = P(good->bad),
+                                   R = P(bad->good), LG/LB and CG/CB the
+                                   loss and corruption rates in good/bad
+     markov:FILE                   n-state chain read from FILE: the
+                                   number of states, then one line per
+                                   state "loss corrupt p0 p1 ... pn-1"
+     trace:FILE[,loop][,scale=S]   replay a recorded trace: one record
+                                   per packet with its one way delay and
+                                   whether it was lost or corrupted
+
+   A trace is either CSV, one "delay[,lost[,corrupt]]" line per packet
+   (lost and corrupt 0 or 1, # starts a comment), or binary: the eight
+   bytes "CHTRACE1" and then five bytes per packet, the delay as a
+   little-endian IEEE float and a flags byte (1 lost, 2 corrupted).
+   The file is mapped and read a record at a time as packets are sent.
+   Delays are multiplied by S (default 1).  With loop the trace starts
+   over when it runs out; without, later packets get through with the
+   last delay.  The trace replaces the emulator's random delay too.
+**********************************************************************/
+
+#define CH_MAXSTATES 8
+#define CH_BURSTS    17     /* loss burst histogram: 1..16, then longer */
+
+struct channel {
+  char name[16];        /* model name, for reports */
+  int nstates;
+  double loss[CH_MAXSTATES];
+  double corrupt[CH_MAXSTATES];
+  double cumtrans[CH_MAXSTATES][CH_MAXSTATES]; /* cumulative transition rows */
+
+  /* trace replay */
+  char *tracefile;      /* NULL for the Markov models */
+  const unsigned char *map;
+  size_t mapsize;
+  size_t start;         /* offset of the first record */
+  int binary;
+  int loop;
+  double scale;
+
+  int state;            /* state for the next packet */
+  int pktstate;         /* state the current packet was sent in */
+
+  /* statistics */
+  int packets;          /* packets offered to this direction */
+  int lost;
+  int corrupted;
+  int run;              /* length of the current run of losses */
+  int nbursts;          /* number of completed loss bursts */
+  int maxburst;
+  long burstsum;
+  int bursts[CH_BURSTS];
+  int visits[CH_MAXSTATES]; /* packets sent in each state */
+
+  size_t pos;           /* trace: offset of the next record */
+  double delay;         /* and what the current one said */
+  int tracelost;
+  int tracecorrupt;
+  int wraps;            /* times the trace started over */
+  int overrun;          /* packets sent after it ran out */
+};
+
+/* parse a model SPEC into c; returns 0 on success */
+extern int channel_parse(struct channel *c, const char *spec);
+
+/* make c the one-state model with the given probabilities */
+extern void channel_bernoulli(struct channel *c, double loss, double corrupt);
+
+/* reset c's state and statistics */
+extern void channel_start(struct channel *c);
+
+/* a packet enters the medium: returns 1 if it is lost.  Advances the
+   chain, so call exactly once per packet and before channel_corrupt() */
+extern int channel_lose(struct channel *c);
+
+/* returns 1 if the packet that was not lost is to be corrupted */
+extern int channel_corrupt(struct channel *c);
+
+/* for a trace, set *delay to the recorded delay of the current packet
+   and return 1; for the other models return 0 */
+extern int channel_delay(const struct channel *c, double *delay);
+
+/* print c's statistics, labelled with the sending entity */
+extern void channel_report(struct channel *c, int AorB);
+
+#endif
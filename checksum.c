@@ -0,0 +1,276 @@
+/* ******************************************************************
+   Packet integrity functions.  See checksum.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "checksum.h"
+#include "instrument.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int checksum_kind = CK_SUM;
+
+static const char *names[] = { "sum", "crc32c", "inet" };
+
+int checksum_parse(const char *name)
+{
+  int i;
+
+  for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    if (strcmp(name, names[i]) == 0)
+      return i;
+  return -1;
+}
+
+const char *checksum_name(int kind)
+{
+  return names[kind];
+}
+
+/* CRC-32C, reflected polynomial */
+#define CRC32C_POLY 0x82f63b78u
+
+static uint32_t crctable[256];
+static int crcready;
+
+static void crcinit(void)
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (k = 0; k < 8; k++)
+      c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+    crctable[i] = c;
+  }
+  crcready = 1;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+
+  if (!crcready)
+    crcinit();
+  crc = ~crc;
+  while (len-- > 0)
+    crc = (crc >> 8) ^ crctable[(crc ^ *p++) & 0xff];
+  return ~crc;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+#if defined(__SSE4_2__)
+  const unsigned char *p = buf;
+
+  crc = ~crc;
+#if defined(__x86_64__)
+  {
+    uint64_t c = crc, w;
+
+    for (; len >= 8; p += 8, len -= 8) {
+      memcpy(&w, p, 8);
+      c = _mm_crc32_u64(c, w);
+    }
+    crc = (uint32_t)c;
+  }
+#endif
+  {
+    uint32_t w;
+
+    for (; len >= 4; p += 4, len -= 4) {
+      memcpy(&w, p, 4);
+      crc = _mm_crc32_u32(crc, w);
+    }
+  }
+  while (len-- > 0)
+    crc = _mm_crc32_u8(crc, *p++);
+  return ~crc;
+#else
+  return crc32c_sw(crc, buf, len);
+#endif
+}
+
+/* the Internet checksum works on 16 bit words, here taken in host byte
+   order; the ones-complement sum comes out the same whichever order is
+   used, byte swapped.  A buffer of odd length is padded with a zero, so
+   only the last of a series of calls may have one. */
+
+/* fold a 64 bit sum of words into 32 bits, keeping the carries */
+static uint32_t fold32(uint64_t s)
+{
+  s = (s & 0xffffffffu) + (s >> 32);
+  s = (s & 0xffffffffu) + (s >> 32);
+  return (uint32_t)s;
+}
+
+uint32_t inet_sum_sw(uint32_t sum, const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+  uint64_t s = sum;
+  uint16_t w;
+
+  for (; len >= 2; p += 2, len -= 2) {
+    memcpy(&w, p, 2);
+    s += w;
+  }
+  if (len > 0) {
+    w = 0;
+    memcpy(&w, p, 1);
+    s += w;
+  }
+  return fold32(s);
+}
+
+uint32_t inet_sum(uint32_t sum, const void *buf, size_t len)
+{
+#if defined(__SSE2__)
+  const unsigned char *p = buf;
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t s = sum;
+  uint32_t lane[4];
+  __m128i acc, v;
+  size_t n;
+
+  /* widen 16 byte blocks to 32 bit lanes; each block adds less than
+     2^17 to a lane, so 2^14 blocks can go before the lanes are drained */
+  while (len >= 16) {
+    acc = zero;
+    for (n = 0; n < 16384 && len >= 16; n++, p += 16, len -= 16) {
+      v = _mm_loadu_si128((const __m128i *)p);
+      acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+      acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+    }
+    _mm_storeu_si128((__m128i *)lane, acc);
+    s += (uint64_t)lane[0] + lane[1] + lane[2] + lane[3];
+  }
+  return inet_sum_sw(fold32(s), p, len);
+#else
+  return inet_sum_sw(sum, buf, len);
+#endif
+}
+
+uint16_t inet_fold(uint32_t sum)
+{
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t)~sum;
+}
+
+/* seqnum and acknum lie next to each other ahead of checksum, so the
+   header is covered without copying the packet or skipping a field */
+int pkt_checksum(const struct pkt *p)
+{
+  int checksum;
+  uint32_t c;
+  int i;
+
+  switch (checksum_kind) {
+  case CK_CRC32C:
+    c = crc32c(0, &p->seqnum, 2 * sizeof(int));
+    return (int)crc32c(c, p->payload, sizeof(p->payload));
+  case CK_INET:
+    c = inet_sum(0, &p->seqnum, 2 * sizeof(int));
+    return inet_fold(inet_sum(c, p->payload, sizeof(p->payload)));
+  default:
+    checksum = p->seqnum + p->acknum;
+    for (i = 0; i < 20; i++)
+      checksum += (int)(p->payload[i]);
+    return checksum;
+  }
+}
+
+/* ---------------------------------------------------------------- */
+
+#define BENCH_MAX   65536
+#define BENCH_BYTES (64 << 20)  /* bytes run through each function per size */
+
+static uint32_t sumbytes(uint32_t s, const void *buf, size_t len)
+{
+  const signed char *p = buf;
+
+  while (len-- > 0)
+    s += *p++;
+  return s;
+}
+
+void checksum_bench(void)
+{
+  static const size_t sizes[] = { 28, 64, 256, 1500, BENCH_MAX };
+  static const struct {
+    const char *name;
+    uint32_t (*fn)(uint32_t, const void *, size_t);
+  } fns[] = {
+    { "sum", sumbytes },
+    { "crc32c table", crc32c_sw },
+#if defined(__SSE4_2__)
+    { "crc32c sse4.2", crc32c },
+#endif
+    { "inet scalar", inet_sum_sw },
+#if defined(__SSE2__)
+    { "inet sse2", inet_sum },
+#endif
+  };
+  volatile uint32_t sink = 0;
+  unsigned char *buf;
+  struct pkt pkt;
+  uint64_t t;
+  long reps, r;
+  int f, i, kind;
+
+  if ((buf = malloc(BENCH_MAX)) == NULL) {
+    printf("memory allocation for benchmark buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  srand(1);
+  for (i = 0; i < BENCH_MAX; i++)
+    buf[i] = rand();
+#if defined(__x86_64__) || defined(__i386__)
+  printf("bytes per cycle (TSC cycles)\n");
+#else
+  printf("bytes per nanosecond (no cycle counter)\n");
+#endif
+  printf("%-16s", "");
+  for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+    printf("%10zu", sizes[i]);
+  printf("\n");
+  for (f = 0; f < (int)(sizeof(fns) / sizeof(fns[0])); f++) {
+    printf("%-16s", fns[f].name);
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+      reps = BENCH_BYTES / sizes[i];
+      sink += fns[f].fn(0, buf, sizes[i]);     /* warm up */
+      t = instr_cycles();
+      for (r = 0; r < reps; r++)
+        sink += fns[f].fn(sink, buf, sizes[i]);
+      t = instr_cycles() - t;
+      printf("%10.2f", t > 0 ? (double)reps * sizes[i] / t : 0.0);
+    }
+    printf("\n");
+  }
+
+  /* the whole per-packet cost, 28 bytes in place, as the protocols see it */
+  memcpy(&pkt, buf, sizeof(pkt));
+  kind = checksum_kind;
+  printf("packet checksum (bytes per cycle, 28 bytes):");
+  for (checksum_kind = CK_SUM; checksum_kind <= CK_INET; checksum_kind++) {
+    reps = BENCH_BYTES / 28;
+    t = instr_cycles();
+    for (r = 0; r < reps; r++) {
+      pkt.acknum = r;
+      sink += pkt_checksum(&pkt);
+    }
+    t = instr_cycles() - t;
+    printf(" %s %.2f", names[checksum_kind], t > 0 ? (double)reps * 28 / t : 0.0);
+  }
+  checksum_kind = kind;
+  printf("\n");
+  free(buf);
+}
@@ -0,0 +1,53 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+/* ******************************************************************
+   Packet integrity functions.
+
+   The protocols protect seqnum, acknum and the payload with the
+   function selected by checksum_kind (--checksum), computed in place:
+
+     sum      the original additive sum; misses reordered bytes and
+              errors that cancel out
+     crc32c   CRC-32C (Castagnoli), with the SSE4.2 crc32 instruction
+              when the compiler targets it (-msse4.2 or -march=native)
+              and a table otherwise
+     inet     the Internet ones-complement checksum (RFC 1071), summed
+              16 bytes at a time with SSE2 where available
+
+   Both ends must of course use the same one.  The buffer functions
+   take any length, so larger payloads cost no more per byte.
+**********************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CK_SUM    0
+#define CK_CRC32C 1
+#define CK_INET   2
+
+extern int checksum_kind;
+
+/* the CK_* code of a name, or -1 */
+extern int checksum_parse(const char *name);
+extern const char *checksum_name(int kind);
+
+/* the checksum of a packet's header and payload, by checksum_kind */
+struct pkt;
+extern int pkt_checksum(const struct pkt *p);
+
+/* CRC-32C of len bytes, continuing from crc (start with 0) */
+extern uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+extern uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+/* ones-complement sum of len bytes added to sum, not yet folded or
+   inverted; and the folded, inverted checksum of such a sum */
+extern uint32_t inet_sum(uint32_t sum, const void *buf, size_t len);
+extern uint32_t inet_sum_sw(uint32_t sum, const void *buf, size_t len);
+extern uint16_t inet_fold(uint32_t sum);
+
+/* time every implementation over a range of sizes and print bytes
+   per cycle */
+extern void checksum_bench(void);
+
+#endif
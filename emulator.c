@@ -36,37 +36,50 @@
    ********************************************************************* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <getopt.h>
 #include "emulator.h"
-#include "gbn.h"
+#include "protocol.h"
+#include "instrument.h"
+#include "replicate.h"
+#include "fec.h"
+#include "arrival.h"
+#include "channel.h"
+#include "path.h"
+#include "topo.h"
+#include "metrics.h"
+#include "xfer.h"
+#include "checksum.h"
 
 struct event {
   float evtime;           /* event time */
   int evtype;             /* event type code */
   int eventity;           /* entity where event occurs */
   struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  unsigned long evseq;    /* insertion order, see nextarrival() */
+  int path;               /* multipath: path the packet came over */
+  long pktseq;            /* and its place in the order it was sent */
+  int node;               /* topology: node the packet has reached */
+  int source;             /* and its cross-traffic source, or -1 */
   struct event *prev;
   struct event *next;
 };
 
 struct event *evlist = NULL;   /* the event list */
+static int evcount;            /* number of events on the event list */
+static unsigned long nscheduled;  /* events and arrivals scheduled so far */
 
 /* possible events: */
 #define  TIMER_INTERRUPT 0  
 #define  FROM_LAYER5     1
 #define  FROM_LAYER3     2
+#define  RESEQ_TIMEOUT   3   /* multipath: stop waiting for a packet */
+#define  HOP             4   /* topology: a packet reaches the next node */
+#define  CROSS_ARRIVAL   5   /* topology: a cross-traffic packet is sent */
 
 #define  OFF             0
 #define  ON              1
 
-int TRACE = 3;
-
-/* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
-
 /* statistics updated by emulator */
 static int packets_lost;  
 static int packets_corrupt;
@@ -82,9 +95,120 @@ static float corruptprob;   /* probability that one bit is packet is flipped */
 static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
 static float lambda;        /* arrival rate of messages from layer 5 */   
 static int   ntolayer3;           /* number sent into layer 3 */
+static int   npackets[2];         /* and by each entity */
 static int   nlost;               /* number lost in media */
 static int ncorrupt;              /* number corrupted by media*/
 
+static int instrjson;       /* print instrumentation as JSON, not a table */
+
+/* metrics records (--metrics): where they go, how often, and what the
+   previous one said */
+static const char *metricsdest;
+static int metricsformat = METRICS_JSON;
+static double metricsevery;       /* simulated time between snapshots, or 0 */
+static long metricsevents;        /* events between snapshots, or 0 */
+static long nevents;              /* events handled in this run */
+static double nextsnap;
+static long nextsnapev;
+static double wallstart;
+static struct metrics lastsnap;
+static int runno;
+
+/* file transfer (--file): layer 5 sends a file instead of letters */
+static struct xfer xfer;
+static int xfermode;
+
+/* the protocols to run, in turn, and the one running now */
+#define MAXRUNS 16
+static const struct protocol *runlist[MAXRUNS];
+static int nruns;
+static const struct protocol *proto;
+static void *instance;
+static struct protoconf conf;
+
+/* what each run achieved, for the comparison table */
+struct result {
+  int delivered;
+  double time;
+  int sent;               /* packets A gave to layer 3 */
+  int resent;
+  int recoveries;          /* timeout and NACK recoveries together */
+  double recovery_time;
+  int nacks;
+  int parity;             /* FEC parity packets sent */
+  int rebuilt;            /* and packets rebuilt from them */
+  double latency;         /* mean delivery latency */
+};
+static struct result results[MAXRUNS];
+
+/* replications (--replications, --precision); the seed applies to
+   single runs too */
+static unsigned seed = 9999;
+static int replicating;
+static struct repconf repconf = { 0.05, 0.95, 5, 1000, 0, 0 };
+
+/* steady state measurements start at time warmup: the counters as they
+   were then, and the delivery latency of messages delivered after it */
+static double warmup;
+static int warmed;
+static double warmtime;
+static int warmdelivered, warmsent, warmresent;
+static double latencysum;
+static int latencyn;
+
+/* when each message still in flight was accepted by layer 4, oldest
+   first, per sending entity; protocols deliver in order */
+struct acceptq {
+  double *t;
+  int cap, first, count;
+};
+static struct acceptq accepted[2];
+
+/* layer 5 message sources, one per entity that sends; each holds its own
+   pending arrival rather than an event on the event list */
+static struct arrival sources[2];
+static const int nsources = BIDIRECTIONAL ? 2 : 1;
+
+/* loss/corruption model of the medium, indexed by the sending entity.
+   Directions without a --channel model use the prompted probabilities. */
+static struct channel channels[2];
+static int channelset[2];
+
+/* parallel paths (--path), indexed by the sending entity like the
+   channels, and the scheduler that spreads packets over them */
+static struct path paths[2][MAXPATHS];
+static int npaths;
+static int scheduler = SCHED_RR;
+static double reorder = -1.0;   /* --reorder; -1 until defaulted */
+static long pathseq[2];         /* next packet number, per sending entity */
+
+/* packets that come out of the paths out of order wait at the receiving
+   entity until the ones sent before them are in, or for at most the
+   reorder timeout */
+#define RESEQ_HIST 4096
+struct reseq {
+  long next;                    /* packet number to hand to layer 4 next */
+  struct event *held;           /* FROM_LAYER3 events waiting, in order */
+  long seen[RESEQ_HIST];        /* recent packet numbers handed to layer 4,
+                                   or lost on every path they were sent on */
+
+  /* statistics */
+  int nheld;                    /* packets that had to wait */
+  double holdtime;              /* total and longest wait */
+  double holdmax;
+  int skipped;                  /* packets given up on */
+  int late;                     /* arrived after being given up on */
+  int duplicates;               /* redundant copies dropped */
+};
+static struct reseq reseqs[2];
+static struct path *curpath;    /* path of the packet layer 4 is handling */
+
+/* the network between A and B (--topology), and the number of events on
+   the event list that are there only for its cross traffic */
+static struct topology topo;
+static int topology;
+static int ncrossev;
+
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
 /* isolate all random number generation in one location.  We assume that the*/
@@ -95,11 +219,16 @@ double jimsrand(void)
   double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
   double x;                   
   x = rand()/mmm;            /* x should be uniform in [0,1] */
-  if (TRACE > 3)
+  if (TRACING(4))
     printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
   return(x);
 }  
 
+double gettime(void)
+{
+  return time;
+}
+
 /********************* EVENT HANDLINE ROUTINES *******/
 /*  The next set of routines handle the event list   */
 /*****************************************************/
@@ -107,8 +236,11 @@ double jimsrand(void)
 void insertevent(struct event *p)
 {
   struct event *q,*qold;
+  INSTR_START(mark);
 
-  if (TRACE>2) {
+  evcount++;
+  p->evseq = nscheduled++;
+  if (TRACING(3)) {
     printf("            INSERTEVENT: time is %f\n",time);
     printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
   }
@@ -139,32 +271,35 @@ void insertevent(struct event *p)
       q->prev=p;
     }
   }
+  INSTR_STOP(IN_INSERTEVENT, mark);
 }
 
-void generate_next_arrival(void)
+void generate_next_arrival(struct arrival *src)
 {
-  double x;
-  struct event *evptr;
-
-  if (TRACE>2)
+  if (TRACING(3))
     printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
  
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
-  /* having mean of lambda        */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + x;
-  evptr->evtype =  FROM_LAYER5;
-  if (BIDIRECTIONAL && (jimsrand()>0.5) )
-    evptr->eventity = B;
-  else
-    evptr->eventity = A;
-  insertevent(evptr);
+  arrival_advance(src, time);   /* gaps have a mean of lambda */
+  src->seq = nscheduled++;
 } 
 
+/* the source whose pending arrival comes before the head of the event
+   list, or NULL if the next thing to happen is on the event list.  Equal
+   times go to whichever was scheduled last, as insertevent() does. */
+static struct arrival *nextarrival(void)
+{
+  struct arrival *src = NULL;
+  int i;
+
+  for (i = 0; i < nsources; i++)
+    if (sources[i].active && !sources[i].paused && (src == NULL || sources[i].next < src->next))
+      src = &sources[i];
+  if (src != NULL && evlist != NULL && (evlist->evtime < src->next ||
+      (evlist->evtime == src->next && evlist->evseq > src->seq)))
+    return NULL;
+  return src;
+}
+
 void printevlist(void)
 {
   struct event *q;
@@ -177,9 +312,6 @@ void printevlist(void)
 
 void init(void)                         /* initialize the simulator */
 {
-  float sum, avg;
-  int i;
-
   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
   printf("Enter the number of messages to simulate: ");
   scanf("%d",&nsimmax);
@@ -195,9 +327,18 @@ void init(void)                         /* initialize the simulator */
   scanf("%f",&lambda);
   printf("Enter TRACE:");
   scanf("%d",&TRACE);
+  if (TRACE > TRACE_MAX)
+    printf("(this build traces up to level %d only)\n", TRACE_MAX);
+}
 
+/* set the emulator up for a fresh run with the parameters from init() */
+static void reset(void)
+{
+  struct event *evptr;
+  float sum, avg;
+  int i, j;
 
-  srand(9999);              /* init random number generator */
+  srand(seed);              /* init random number generator */
   sum = 0.0;                /* test random number generator for students */
   for (i=0; i<1000; i++)
     sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
@@ -209,12 +350,52 @@ void init(void)                         /* initialize the simulator */
     exit(EXIT_FAILURE);
   }
 
+  for (i = A; i <= B; i++) {
+    if (!channelset[i]) {
+      if (corruptdirection == (i+1) % 2)   /* loss only the other way */
+        channel_bernoulli(&channels[i], 0.0, 0.0);
+      else
+        channel_bernoulli(&channels[i], lossprob, corruptprob);
+    }
+    channel_start(&channels[i]);
+  }
+  for (i = A; i <= B; i++) {
+    for (j = 0; j < npaths; j++) {
+      if (!paths[i][j].channelset)
+        paths[i][j].ch = channels[i];
+      channel_start(&paths[i][j].ch);
+      path_start(&paths[i][j]);
+    }
+    pathseq[i] = 0;
+    reseqs[i].next = 0;
+    reseqs[i].held = NULL;
+    for (j = 0; j < RESEQ_HIST; j++)
+      reseqs[i].seen[j] = -1;
+    reseqs[i].nheld = reseqs[i].skipped = reseqs[i].late = reseqs[i].duplicates = 0;
+    reseqs[i].holdtime = reseqs[i].holdmax = 0.0;
+  }
+
   /* initialise statistics */
   window_full = 0;
   total_ACKs_received = 0;
   packets_resent = 0;
   new_ACKs = 0;
   packets_received = 0;
+  recoveries = 0;
+  recovery_time = 0.0;
+  messages_queued = 0;
+  queue_delay = 0.0;
+  queue_delay_max = 0.0;
+  backlog_max = 0;
+  backlog_area = 0.0;
+  nacks_sent = 0;
+  nacks_suppressed = 0;
+  nack_resends = 0;
+  nack_recoveries = 0;
+  nack_recovery_time = 0.0;
+  fec_parity_sent = 0;
+  fec_rebuilt = 0;
+  fec_resends_avoided = 0;
   packets_lost = 0;  
   packets_corrupt = 0;
   packets_sent = 0;
@@ -222,11 +403,87 @@ void init(void)                         /* initialize the simulator */
   messages_delivered = 0;
 
   ntolayer3 = 0;
+  npackets[A] = npackets[B] = 0;
   nlost = 0;
   ncorrupt = 0;
+  nsim = 0;
+
+  warmed = 0;
+  latencysum = 0.0;
+  latencyn = 0;
+  for (i = A; i <= B; i++)
+    accepted[i].first = accepted[i].count = 0;
+
+  evcount = 0;
+  nscheduled = 0;
+  INSTR_INIT();
+
+  if (xfermode)
+    xfer_start(&xfer);
+
+  nevents = 0;
+  nextsnap = metricsevery;
+  nextsnapev = metricsevents;
+  memset(&lastsnap, 0, sizeof(lastsnap));
+  wallstart = metrics_clock();
 
   time=0.0;                    /* initialize time to 0.0 */
-  generate_next_arrival();     /* initialize event list */
+  for (i = 0; i < nsources; i++) {   /* schedule the first arrivals; with */
+    arrival_start(&sources[i], lambda * nsources, time);   /* two sources */
+    sources[i].seq = nscheduled++;   /* each sends at half the rate */
+  }
+
+  ncrossev = 0;
+  if (topology) {
+    topo_start(&topo, time);
+    for (i = 0; i < topo.ncross; i++) {
+      evptr = malloc(sizeof(struct event));
+      if (evptr == 0) {
+        printf("memory allocation for event failed.");
+        exit(EXIT_FAILURE);
+      }
+      evptr->evtime = topo.cross[i].arr.next;
+      evptr->evtype = CROSS_ARRIVAL;
+      evptr->eventity = -1;
+      evptr->pktptr = NULL;
+      evptr->source = i;
+      ncrossev++;
+      insertevent(evptr);
+    }
+  }
+}
+
+/* the warm-up period is over at the first event at or after warmup */
+static void checkwarmup(void)
+{
+  if (warmed || time < warmup)
+    return;
+  warmed = 1;
+  warmtime = time;
+  warmdelivered = messages_delivered;
+  warmsent = npackets[A];
+  warmresent = packets_resent;
+}
+
+static void pushaccepted(struct acceptq *q, double t)
+{
+  double *nt;
+  int i;
+
+  if (q->count == q->cap) {
+    nt = malloc((q->cap ? 2 * q->cap : 64) * sizeof(double));
+    if (nt == NULL) {
+      printf("memory allocation for message times failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < q->count; i++)
+      nt[i] = q->t[(q->first + i) % q->cap];
+    free(q->t);
+    q->t = nt;
+    q->first = 0;
+    q->cap = q->cap ? 2 * q->cap : 64;
+  }
+  q->t[(q->first + q->count++) % q->cap] = t;
 }
 
 /********************** Student-callable ROUTINES ***********************/
@@ -236,8 +493,9 @@ void stoptimer(int AorB)
 /* A or B is trying to stop timer */
 {
   struct event *q;
+  INSTR_START(mark);
 
-  if (TRACE>1)
+  if (TRACING(2))
     printf("          STOP TIMER: stopping timer at %f\n",time);
   /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
   for (q=evlist; q!=NULL ; q = q->next) 
@@ -256,9 +514,12 @@ void stoptimer(int AorB)
         q->prev->next =  q->next;
       }
       free(q);
+      evcount--;
+      INSTR_STOP(IN_STOPTIMER, mark);
       return;
     }
   printf("Warning: unable to cancel your timer. It wasn't running.\n");
+  INSTR_STOP(IN_STOPTIMER, mark);
 }
 
 
@@ -268,14 +529,16 @@ void starttimer(int AorB, double increment)
 
   struct event *q;
   struct event *evptr;
+  INSTR_START(mark);
 
-  if (TRACE>1)
+  if (TRACING(2))
     printf("          START TIMER: starting timer at %f\n",time);
   /* be nice: check to see if timer is already started, if so, then  warn */
   /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
   for (q=evlist; q!=NULL ; q = q->next)  
     if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
       printf("Warning: attempt to start a timer that is already started\n");
+      INSTR_STOP(IN_STARTTIMER, mark);
       return;
     }
  
@@ -291,25 +554,177 @@ void starttimer(int AorB, double increment)
  
   evptr->eventity = AorB;
   insertevent(evptr);
+  INSTR_STOP(IN_STARTTIMER, mark);
 } 
 
 
+/* called by students routine to hold back or resume messages from layer 5 */
+void stoplayer5(int AorB)
+{
+  if (TRACING(2))
+    printf("          STOP LAYER5: stopping layer 5 at %f\n",time);
+  arrival_pause(&sources[AorB], time);
+}
+
+void startlayer5(int AorB)
+{
+  if (TRACING(2))
+    printf("          START LAYER5: restarting layer 5 at %f\n",time);
+  arrival_resume(&sources[AorB], time);
+  sources[AorB].seq = nscheduled++;
+}
+
+/* the medium corrupts the packet at p */
+static void corruptpkt(struct pkt *p)
+{
+  float x;
+
+  ncorrupt++;
+  if ( (x = jimsrand()) < .75)
+    p->payload[0]='Z';   /* corrupt payload */
+  else if (x < .875)
+    p->seqnum = 999999;
+  else
+    p->acknum = 999999;
+  if (TRACING(1))
+    printf("          TOLAYER3: packet being corrupted\n");
+}
+
+/* tolayer3() with --path: send the packet over the path the scheduler
+   picks, or a copy over each of them */
+static void topaths(int AorB, struct pkt packet)
+{
+  struct path *p;
+  struct pkt *mypktptr;
+  struct event *evptr;
+  long seq = pathseq[AorB]++;
+  int i, first, last, lost = 1;
+
+  if (scheduler == SCHED_REDUNDANT) {
+    first = 0;
+    last = npaths - 1;
+  }
+  else
+    first = last = path_pick(paths[AorB], npaths, scheduler, time);
+
+  for (i = first; i <= last; i++) {
+    p = &paths[AorB][i];
+    p->sent++;
+    if (channel_lose(&p->ch)) {
+      nlost++;
+      if (TRACING(1))
+        printf("          TOLAYER3: packet being lost on path %d\n", i + 1);
+      continue;
+    }
+    lost = 0;
+    mypktptr = malloc(sizeof(struct pkt));
+    evptr = malloc(sizeof(struct event));
+    if (mypktptr == 0 || evptr == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    *mypktptr = packet;
+    evptr->evtype = FROM_LAYER3;
+    evptr->eventity = (AorB+1) % 2;
+    evptr->pktptr = mypktptr;
+    evptr->path = i;
+    evptr->pktseq = seq;
+    evptr->evtime = path_send(p, time);
+    if (channel_corrupt(&p->ch))
+      corruptpkt(mypktptr);
+    if (TRACING(3))
+      printf("          TOLAYER3: scheduling arrival on other side over path %d\n", i + 1);
+    insertevent(evptr);
+  }
+  /* nothing will arrive, so the receiver must not wait for it */
+  if (lost)
+    reseqs[(AorB+1) % 2].seen[seq % RESEQ_HIST] = seq;
+}
+
+/* topology: send the packet of eventptr, which is at eventptr->node, on
+   over the next link toward its destination.  Takes over the event. */
+static void hop(struct event *eventptr)
+{
+  int cross = eventptr->source >= 0;
+  int dest = cross ? topo.cross[eventptr->source].to : eventptr->eventity == A ? TOPO_A : TOPO_B;
+  struct link *l = topo_route(&topo, eventptr->node, dest);
+  double t = link_send(l, time);
+  int lost = t < 0.0;
+
+  if (cross)
+    l->cross++;
+  if (!lost && l->channelset) {
+    lost = channel_lose(&l->ch);
+    if (lost)
+      l->lost++;
+    else if (channel_corrupt(&l->ch)) {
+      l->corrupted++;
+      if (!cross)
+        corruptpkt(eventptr->pktptr);
+    }
+  }
+  if (lost) {
+    if (!cross) {
+      nlost++;
+      if (TRACING(1))
+        printf("          TOLAYER3: packet %s on %s->%s\n", t < 0.0 ? "dropped at the queue" : "being lost",
+               topo.names[l->from], topo.names[l->to]);
+      free(eventptr->pktptr);
+    }
+    free(eventptr);
+    return;
+  }
+  if (TRACING(3) && !cross)
+    printf("          TOLAYER3: packet forwarded from %s to %s\n", topo.names[l->from], topo.names[l->to]);
+  eventptr->evtype = HOP;
+  eventptr->node = l->to;
+  eventptr->evtime = t;
+  if (cross)
+    ncrossev++;
+  insertevent(eventptr);
+}
+
 /************************** TOLAYER3 ***************/
 void tolayer3(int AorB, struct pkt packet)
 /* A or B is sending to network  */
 {
   struct pkt *mypktptr;
   struct event *evptr,*q;
-  float lastime, x;
+  float lastime;
+  double tracedelay;
   int i;
+  INSTR_START(mark);
 
   ntolayer3++;
+  npackets[AorB]++;
+  if (npaths > 0) {
+    topaths(AorB, packet);
+    INSTR_STOP(IN_TOLAYER3, mark);
+    return;
+  }
+  if (topology) {
+    mypktptr = malloc(sizeof(struct pkt));
+    evptr = malloc(sizeof(struct event));
+    if (mypktptr == 0 || evptr == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    *mypktptr = packet;
+    evptr->eventity = (AorB+1) % 2;
+    evptr->pktptr = mypktptr;
+    evptr->node = AorB == A ? TOPO_A : TOPO_B;
+    evptr->source = -1;
+    hop(evptr);
+    INSTR_STOP(IN_TOLAYER3, mark);
+    return;
+  }
 
   /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+  if (channel_lose(&channels[AorB])) {
     nlost++;
-    if (TRACE>0)    
+    if (TRACING(1))    
       printf("          TOLAYER3: packet being lost\n");
+    INSTR_STOP(IN_TOLAYER3, mark);
     return;
   }  
 
@@ -325,7 +740,7 @@ void tolayer3(int AorB, struct pkt packet)
   mypktptr->checksum = packet.checksum;
   for (i=0; i<20; i++)
     mypktptr->payload[i] = packet.payload[i];
-  if (TRACE>2)  {
+  if (TRACING(3))  {
     printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
            mypktptr->acknum,  mypktptr->checksum);
     for (i=0; i<20; i++)
@@ -351,32 +766,30 @@ void tolayer3(int AorB, struct pkt packet)
   for (q=evlist; q!=NULL ; q = q->next) 
     if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
       lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
+  if (channel_delay(&channels[AorB], &tracedelay))   /* recorded delay, */
+    evptr->evtime = time + tracedelay > lastime ? time + tracedelay : lastime;   /* still FIFO */
+  else
+    evptr->evtime =  lastime + 1 + 9*jimsrand();
  
 
 
   /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
-    else if (x < .875)
-      mypktptr->seqnum = 999999;
-    else
-      mypktptr->acknum = 999999;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being corrupted\n");
-  }  
+  if (channel_corrupt(&channels[AorB]))
+    corruptpkt(mypktptr);
 
-  if (TRACE>2)  
+  if (TRACING(3))  
     printf("          TOLAYER3: scheduling arrival on other side\n");
   insertevent(evptr);
+  INSTR_STOP(IN_TOLAYER3, mark);
 } 
 
 void tolayer5(int AorB, char datasent[20])
 {
+  struct acceptq *q;
   int i;  
-  if (TRACE>2) {
+  INSTR_START(mark);
+
+  if (TRACING(3)) {
     printf("          TOLAYER5: data received by application at ");
     if (AorB == A) 
       printf("A: ");
@@ -387,92 +800,835 @@ void tolayer5(int AorB, char datasent[20])
     printf("\n");
   }
   messages_delivered++;
+  sources[(AorB+1) % 2].delivered++;
+  if (curpath != NULL)
+    curpath->delivered++;
+  if (xfermode && AorB == B)
+    xfer_deliver(&xfer, datasent);
+  q = &accepted[(AorB+1) % 2];
+  if (q->count > 0) {
+    if (warmed) {
+      latencysum += time - q->t[q->first];
+      latencyn++;
+    }
+    q->first = (q->first + 1) % q->cap;
+    q->count--;
+  }
+  INSTR_STOP(IN_TOLAYER5, mark);
 }
 
-int main(void)
+static void usage(const char *prog)
+{
+  int i;
+
+  printf("usage: %s [options]\n", prog);
+  printf("  --protocol=NAME|all      transport protocol to run (default gbn), or\n");
+  printf("                           run the scenario under each and compare:\n");
+  for (i = 0; protocols[i] != NULL; i++)
+    printf("                             %-10s %s\n", protocols[i]->name, protocols[i]->description);
+  printf("  --arrival=SPEC           layer 5 arrival model: uniform (default),\n");
+  printf("                           poisson, onoff:ON,OFF, pareto:ALPHA,\n");
+  printf("                           constant or trace:FILE\n");
+  printf("  --channel=SPEC           loss/corruption model for both directions:\n");
+  printf("                           bernoulli:LOSS,CORRUPT,\n");
+  printf("                           ge:P,R,LG,LB[,CG,CB], markov:FILE or\n");
+  printf("                           trace:FILE[,loop][,scale=S] (see channel.h)\n");
+  printf("  --channel-ab=SPEC        model for A->B only\n");
+  printf("  --channel-ba=SPEC        model for B->A only\n");
+  printf("  --path=SPEC               add a parallel path (up to %d) instead of the\n", MAXPATHS);
+  printf("                           single channel: DELAY,JITTER[,RATE][/CHANNEL]\n");
+  printf("  --scheduler=NAME         path for each packet: rr (default), minrtt,\n");
+  printf("                           weighted (by rate) or redundant (all paths)\n");
+  printf("  --reorder=T              longest a packet waits for those sent before it\n");
+  printf("                           (default: the largest path delay plus jitter)\n");
+  printf("  --topology=FILE          routers, links and cross traffic between A and B\n");
+  printf("                           (see topo.h); the prompted loss and corruption\n");
+  printf("                           probabilities are not used\n");
+  printf("  --file=IN[,OUT]          send the file IN instead of the prompted number\n");
+  printf("                           of messages, write what B receives to OUT and\n");
+  printf("                           check it\n");
+  printf("  --sack                   selective acknowledgements (gbn only)\n");
+  printf("  --nack                   negative acknowledgements (gbn only)\n");
+  printf("  --fec=K[,M]              forward error correction: M parity packets\n");
+  printf("                           (default 1) after every K new packets; one\n");
+  printf("                           parity packet is an XOR, more are Reed-Solomon\n");
+  printf("                           (gbn only; K at most %d, the window size)\n",
+         findprotocol("gbn")->fec_maxk);
+  printf("  --backlog=N[,tail|block] queue up to N messages at A while the window\n");
+  printf("                           is full; when the queue is full too drop the\n");
+  printf("                           message (tail, default) or stop layer 5 (block)\n");
+  printf("  --checksum=NAME          packet checksum: sum (default), crc32c or inet\n");
+  printf("  --checksum-bench         time the checksum functions and exit\n");
+  printf("  --seed=N                 random seed (default 9999)\n");
+  printf("  --replications=MIN[,MAX] rerun the scenario with seeds N, N+1, ... and\n");
+  printf("                           report confidence intervals for goodput, resend\n");
+  printf("                           ratio and delivery latency; stop once all are\n");
+  printf("                           precise enough, but not before MIN (default 5)\n");
+  printf("                           or after MAX (default 1000) replications\n");
+  printf("  --precision=REL          relative half width to stop at (default 0.05)\n");
+  printf("  --confidence=C           confidence level (default 0.95)\n");
+  printf("  --warmup=T               measure only after time T (replications)\n");
+  printf("  --jobs=N                 replications run at once (default: all cores)\n");
+  printf("  --metrics=FILE|unix:PATH write machine-readable statistics to FILE (- for\n");
+  printf("                           standard output) or a listening Unix socket\n");
+  printf("  --metrics-format=json|csv  JSON lines (default) or CSV\n");
+  printf("  --metrics-every=T        also write a snapshot every T time units\n");
+  printf("  --metrics-events=N       and/or every N events\n");
+  printf("  --instrument=table|json  format of the instrumentation report\n");
+  printf("                           (needs a build with -DINSTRUMENT)\n");
+  printf("  --help                   show this message\n");
+}
+
+/* command line options; the simulation parameters are still read by init() */
+static void parseargs(int argc, char **argv)
+{
+  static const struct option longopts[] = {
+    { "protocol",   required_argument, NULL, 'p' },
+    { "arrival",    required_argument, NULL, 'a' },
+    { "channel",    required_argument, NULL, 'c' },
+    { "channel-ab", required_argument, NULL, '0' },
+    { "channel-ba", required_argument, NULL, '1' },
+    { "path",       required_argument, NULL, 'm' },
+    { "scheduler",  required_argument, NULL, 'x' },
+    { "reorder",    required_argument, NULL, 'o' },
+    { "topology",   required_argument, NULL, 'T' },
+    { "file",       required_argument, NULL, 'X' },
+    { "sack",       no_argument,       NULL, 's' },
+    { "nack",       no_argument,       NULL, 'N' },
+    { "fec",        required_argument, NULL, 'F' },
+    { "backlog",    required_argument, NULL, 'b' },
+    { "checksum",   required_argument, NULL, 'k' },
+    { "checksum-bench", no_argument,   NULL, 'K' },
+    { "seed",       required_argument, NULL, 'S' },
+    { "replications", required_argument, NULL, 'r' },
+    { "precision",  required_argument, NULL, 'P' },
+    { "confidence", required_argument, NULL, 'C' },
+    { "warmup",     required_argument, NULL, 'w' },
+    { "jobs",       required_argument, NULL, 'j' },
+    { "metrics",    required_argument, NULL, 'M' },
+    { "metrics-format", required_argument, NULL, 'f' },
+    { "metrics-every", required_argument, NULL, 'e' },
+    { "metrics-events", required_argument, NULL, 'E' },
+    { "instrument", required_argument, NULL, 'I' },
+    { "help",       no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int c, i;
+
+  arrival_parse(&sources[A], "uniform");
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+    case 'p':
+      if (strcmp(optarg, "all") == 0) {
+        for (nruns = 0; protocols[nruns] != NULL && nruns < MAXRUNS; nruns++)
+          runlist[nruns] = protocols[nruns];
+      }
+      else if ((runlist[0] = findprotocol(optarg)) != NULL)
+        nruns = 1;
+      else {
+        printf("unknown protocol: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'a':
+      if (arrival_parse(&sources[A], optarg) != 0) {
+        printf("bad arrival model: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'c':
+    case '0':
+    case '1':
+      for (i = A; i <= B; i++) {
+        if (c != 'c' && c != '0' + i)
+          continue;
+        if (channel_parse(&channels[i], optarg) != 0) {
+          printf("bad channel model: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        channelset[i] = 1;
+      }
+      break;
+    case 'm':
+      if (npaths == MAXPATHS || path_parse(&paths[A][npaths], optarg) != 0) {
+        printf("bad path: %s (at most %d paths)\n", optarg, MAXPATHS);
+        exit(EXIT_FAILURE);
+      }
+      paths[B][npaths] = paths[A][npaths];
+      npaths++;
+      break;
+    case 'x':
+      if ((scheduler = sched_parse(optarg)) < 0) {
+        printf("unknown scheduler: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'o':
+      if (sscanf(optarg, "%lf", &reorder) != 1 || reorder < 0.0) {
+        printf("bad reorder timeout: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'T':
+      if (topo_load(&topo, optarg) != 0)
+        exit(EXIT_FAILURE);
+      topology = 1;
+      break;
+    case 'X':
+      if (xfer_open(&xfer, optarg) != 0)
+        exit(EXIT_FAILURE);
+      xfermode = 1;
+      break;
+    case 's':
+      conf.sack = 1;
+      break;
+    case 'N':
+      conf.nack = 1;
+      break;
+    case 'F':
+      conf.fec_m = 1;
+      if (sscanf(optarg, "%d,%d", &conf.fec_k, &conf.fec_m) < 1 || conf.fec_k < 1 ||
+          conf.fec_k > FEC_MAXK || conf.fec_m < 1 || conf.fec_m > FEC_MAXM) {
+        printf("bad fec: %s (at most %d packets and %d parity per group)\n", optarg,
+               FEC_MAXK, FEC_MAXM);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'b':
+      {
+        char policy[8] = "tail";
+        if (sscanf(optarg, "%d,%7s", &conf.backlog_capacity, policy) < 1 || conf.backlog_capacity < 0 ||
+            (strcmp(policy, "tail") != 0 && strcmp(policy, "block") != 0)) {
+          printf("bad backlog: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        conf.backlog_block = strcmp(policy, "block") == 0;
+      }
+      break;
+    case 'k':
+      if ((checksum_kind = checksum_parse(optarg)) < 0) {
+        printf("unknown checksum: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'K':
+      checksum_bench();
+      exit(EXIT_SUCCESS);
+    case 'S':
+      if (sscanf(optarg, "%u", &seed) != 1) {
+        printf("bad seed: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'r':
+      repconf.maxreps = 1000;
+      if (sscanf(optarg, "%d,%d", &repconf.minreps, &repconf.maxreps) < 1 ||
+          repconf.minreps < 2 || repconf.maxreps < repconf.minreps) {
+        printf("bad replications: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      replicating = 1;
+      break;
+    case 'P':
+      if (sscanf(optarg, "%lf", &repconf.precision) != 1 || repconf.precision <= 0.0) {
+        printf("bad precision: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      replicating = 1;
+      break;
+    case 'C':
+      if (sscanf(optarg, "%lf", &repconf.confidence) != 1 ||
+          repconf.confidence <= 0.0 || repconf.confidence >= 1.0) {
+        printf("bad confidence: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'w':
+      if (sscanf(optarg, "%lf", &warmup) != 1 || warmup < 0.0) {
+        printf("bad warmup: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'j':
+      if (sscanf(optarg, "%d", &repconf.jobs) != 1 || repconf.jobs < 1) {
+        printf("bad jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'M':
+      metricsdest = optarg;
+      break;
+    case 'f':
+      if (strcmp(optarg, "json") == 0)
+        metricsformat = METRICS_JSON;
+      else if (strcmp(optarg, "csv") == 0)
+        metricsformat = METRICS_CSV;
+      else {
+        printf("unknown metrics format: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'e':
+      if (sscanf(optarg, "%lf", &metricsevery) != 1 || metricsevery <= 0.0) {
+        printf("bad metrics interval: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'E':
+      if (sscanf(optarg, "%ld", &metricsevents) != 1 || metricsevents <= 0) {
+        printf("bad metrics interval: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'I':
+      if (strcmp(optarg, "json") == 0)
+        instrjson = 1;
+      else if (strcmp(optarg, "table") == 0)
+        instrjson = 0;
+      else {
+        printf("unknown instrumentation format: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  sources[B] = sources[A];
+  if (metricsdest != NULL && replicating) {
+    printf("--metrics does not go with replications\n");
+    exit(EXIT_FAILURE);
+  }
+  if (xfermode && xfer.out != NULL && replicating) {
+    printf("--file with an output file does not go with replications\n");
+    exit(EXIT_FAILURE);
+  }
+  if (topology && npaths > 0) {
+    printf("--topology and --path do not go together\n");
+    exit(EXIT_FAILURE);
+  }
+  if (reorder < 0.0) {
+    reorder = 0.0;
+    for (i = 0; i < npaths; i++)
+      if (paths[A][i].delay + paths[A][i].jitter > reorder)
+        reorder = paths[A][i].delay + paths[A][i].jitter;
+  }
+  for (i = 0; i < npaths; i++)
+    if (scheduler == SCHED_WEIGHTED && paths[A][i].rate == 0.0) {
+      printf("weighted scheduling needs a rate on every path\n");
+      exit(EXIT_FAILURE);
+    }
+  if (nruns == 0) {
+    runlist[0] = findprotocol("gbn");
+    nruns = 1;
+  }
+  /* every run must get the same options, or a comparison means nothing */
+  for (i = 0; i < nruns; i++)
+    if (protocol_check(runlist[i], &conf) != 0)
+      exit(EXIT_FAILURE);
+}
+
+/* layer 5 still has messages to give layer 4 */
+static int moremessages(void)
+{
+  return xfermode ? xfer_more(&xfer) : nsim < nsimmax;
+}
+
+/* handle the pending layer 5 arrival of src */
+static void fromlayer5(struct arrival *src)
 {
-  struct event *eventptr;
   struct msg  msg2give;
+  int AorB = src == &sources[A] ? A : B;
+  int i,j,dropped;
+
+  INSTR_QUEUE(src->next, evcount);
+  if (TRACING(2)) {
+    printf("\nEVENT time: %f,",src->next);
+    printf("  type: %d",FROM_LAYER5);
+    printf(", fromlayer5 ");
+    printf(" entity: %d\n",AorB);
+  }
+  time = src->next;               /* update time to next event time */
+  checkwarmup();
+  INSTR_START(evmark);
+  if (moremessages()) {
+    generate_next_arrival(src);   /* set up future arrival */
+    /* fill in msg to give with string of same letter */    
+    j = nsim % 26; 
+    for (i=0; i<20; i++)  
+      msg2give.data[i] = 97 + j;
+    if (xfermode)             /* or the next part of the file */
+      xfer_message(&xfer, msg2give.data);
+    if (TRACING(3)) {
+      printf("          MAINLOOP: data given to student: ");
+      for (i=0; i<20; i++) 
+        printf("%c", msg2give.data[i]);
+      printf("\n");
+    }
+    nsim++;
+    src->offered++;
+    dropped = window_full;
+    if (AorB == A) {
+      INSTR_START(cbmark);
+      proto->A_output(instance, msg2give);
+      INSTR_STOP(IN_A_OUTPUT, cbmark);
+    }
+    else {
+      INSTR_START(cbmark);
+      proto->B_output(instance, msg2give);
+      INSTR_STOP(IN_B_OUTPUT, cbmark);
+    }
+    src->dropped += window_full - dropped;
+    if (window_full == dropped) {
+      pushaccepted(&accepted[AorB], time);
+      if (xfermode)
+        xfer_accepted(&xfer);
+    }
+  }
+  else {
+    src->active = 0;
+    if (TRACING(3))
+      printf("          FROM_LAYER5: no more messages to send: \n");
+  }
+  INSTR_STOP(IN_EV_FROM_LAYER5, evmark);
+}
+
+/* give the packet of a FROM_LAYER3 event to its entity, then free it */
+static void handup(struct event *eventptr)
+{
   struct pkt  pkt2give;
-   
-  int i,j;
-  
-  init();
-  A_init();
-  B_init();
-   
+  int i;
+
+  pkt2give.seqnum = eventptr->pktptr->seqnum;
+  pkt2give.acknum = eventptr->pktptr->acknum;
+  pkt2give.checksum = eventptr->pktptr->checksum;
+  for (i=0; i<20; i++)  
+    pkt2give.payload[i] = eventptr->pktptr->payload[i];
+  if (eventptr->eventity ==A) {    /* deliver packet by calling */
+    INSTR_START(cbmark);
+    proto->A_input(instance, pkt2give);   /* appropriate entity */
+    INSTR_STOP(IN_A_INPUT, cbmark);
+  }
+  else {
+    INSTR_START(cbmark);
+    proto->B_input(instance, pkt2give);
+    INSTR_STOP(IN_B_INPUT, cbmark);
+  }
+  INSTR_START(freemark);
+  free(eventptr->pktptr);          /* free the memory for packet */
+  INSTR_STOP(IN_FREE, freemark);
+}
+
+/* multipath: move next past packets that were lost on every path */
+static void skiplost(struct reseq *r)
+{
+  while (r->seen[r->next % RESEQ_HIST] == r->next)
+    r->next++;
+}
+
+/* multipath: hand a packet that arrived (or waited) to layer 4 */
+static void release(struct reseq *r, struct event *eventptr)
+{
+  struct path *p = &paths[(eventptr->eventity+1) % 2][eventptr->path];
+  double hold = time - eventptr->evtime;
+
+  r->holdtime += hold;
+  if (hold > r->holdmax)
+    r->holdmax = hold;
+  r->seen[eventptr->pktseq % RESEQ_HIST] = eventptr->pktseq;
+  if (eventptr->pktseq >= r->next)
+    r->next = eventptr->pktseq + 1;
+  skiplost(r);
+  p->used++;
+  curpath = p;
+  handup(eventptr);
+  curpath = NULL;
+  free(eventptr);
+}
+
+/* hand over the waiting packets numbered up to upto, giving up on the
+   ones missing in between, and then those that follow without a gap */
+static void flush(struct reseq *r, long upto)
+{
+  struct event *q;
+
+  while ((q = r->held) != NULL && (q->pktseq <= upto || q->pktseq == r->next)) {
+    r->held = q->next;
+    if (q->pktseq > r->next) {
+      r->skipped += q->pktseq - r->next;
+      if (TRACING(2))
+        printf("          RESEQUENCE: giving up on packets %ld to %ld\n", r->next, q->pktseq - 1);
+    }
+    release(r, q);
+  }
+}
+
+/* multipath: a packet came out of a path.  Hand it to layer 4 if all
+   packets sent before it have been, else keep it until they have or the
+   reorder timeout expires.  Takes over the event. */
+static void resequence(struct event *eventptr)
+{
+  struct reseq *r = &reseqs[eventptr->eventity];
+  struct event **qq, *evptr;
+
+  paths[(eventptr->eventity+1) % 2][eventptr->path].arrived++;
+  skiplost(r);
+  for (qq = &r->held; *qq != NULL && (*qq)->pktseq < eventptr->pktseq; qq = &(*qq)->next)
+    ;
+  if ((eventptr->pktseq < r->next && r->seen[eventptr->pktseq % RESEQ_HIST] == eventptr->pktseq) ||
+      (*qq != NULL && (*qq)->pktseq == eventptr->pktseq)) {
+    r->duplicates++;      /* a redundant copy of one we have */
+    free(eventptr->pktptr);
+    free(eventptr);
+    return;
+  }
+  if (eventptr->pktseq <= r->next) {
+    if (eventptr->pktseq < r->next)
+      r->late++;
+    release(r, eventptr);
+    flush(r, -1);
+    return;
+  }
+
+  if (TRACING(2))
+    printf("          RESEQUENCE: holding packet %ld, waiting for %ld\n", eventptr->pktseq, r->next);
+  r->nheld++;
+  eventptr->next = *qq;
+  *qq = eventptr;
+  evptr = malloc(sizeof(struct event));
+  if (evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->evtime = time + reorder;
+  evptr->evtype = RESEQ_TIMEOUT;
+  evptr->eventity = eventptr->eventity;
+  evptr->pktptr = NULL;
+  evptr->pktseq = eventptr->pktseq;
+  insertevent(evptr);
+}
+
+/* topology: a packet reached the next node on its way */
+static void reached(struct event *eventptr)
+{
+  struct cross *c;
+
+  if (eventptr->source >= 0) {
+    c = &topo.cross[eventptr->source];
+    if (eventptr->node == c->to) {
+      c->delivered++;
+      free(eventptr);
+      return;
+    }
+  }
+  else if (eventptr->node == (eventptr->eventity == A ? TOPO_A : TOPO_B)) {
+    handup(eventptr);
+    free(eventptr);
+    return;
+  }
+  hop(eventptr);
+}
+
+/* topology: a cross-traffic source sends a packet.  Sources keep going
+   for as long as A and B have anything left to do. */
+static void crossarrival(struct event *eventptr)
+{
+  struct cross *c = &topo.cross[eventptr->source];
+  struct event *evptr = malloc(sizeof(struct event));
+
+  if (evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->eventity = -1;
+  evptr->pktptr = NULL;
+  evptr->node = c->from;
+  evptr->source = eventptr->source;
+  c->sent++;
+  hop(evptr);
+
+  if (moremessages() || evcount > ncrossev) {
+    arrival_advance(&c->arr, time);
+    eventptr->evtime = c->arr.next;
+    ncrossev++;
+    insertevent(eventptr);
+  }
+  else
+    free(eventptr);
+}
+
+/* write a metrics record of the run so far */
+static void snapshot(const char *kind)
+{
+  struct metrics m;
+
+  m.kind = kind;
+  m.protocol = proto->name;
+  m.run = runno;
+  m.time = time;
+  m.wall = metrics_clock() - wallstart;
+  m.events = nevents;
+  m.offered = nsim;
+  m.window_full = window_full;
+  m.sent = npackets[A];
+  m.resent = packets_resent;
+  m.new_acks = new_ACKs;
+  m.acks = total_ACKs_received;
+  m.lost = nlost;
+  m.corrupted = ncorrupt;
+  m.delivered = messages_delivered;
+  m.goodput = time > 0 ? messages_delivered / time : 0.0;
+  m.goodput_now = time > lastsnap.time ?
+    (messages_delivered - lastsnap.delivered) / (time - lastsnap.time) : 0.0;
+  m.queue = evcount;
+  if (strcmp(kind, "final") == 0)
+    lastsnap.wall = lastsnap.events = 0;    /* the whole run's event rate */
+  m.events_per_sec = m.wall > lastsnap.wall ?
+    (nevents - lastsnap.events) / (m.wall - lastsnap.wall) : 0.0;
+  metrics_write(&m);
+  lastsnap = m;
+}
+
+/* a snapshot is due every metricsevery time units and metricsevents events */
+static void checksnapshot(void)
+{
+  if ((metricsevery > 0 && time >= nextsnap) || (metricsevents > 0 && nevents >= nextsnapev)) {
+    snapshot("snapshot");
+    while (metricsevery > 0 && nextsnap <= time)
+      nextsnap += metricsevery;
+    nextsnapev = nevents + metricsevents;
+  }
+}
+
+/* run the simulation until there is nothing left to do */
+static void simulate(void)
+{
+  struct event *eventptr;
+  struct arrival *src;
+
   while (1) {
+    if (metricsdest != NULL)
+      checksnapshot();
+    src = nextarrival();          /* layer 5 arrivals are not on evlist */
+    if (src != NULL) {
+      nevents++;
+      fromlayer5(src);
+      continue;
+    }
     eventptr = evlist;            /* get next event to simulate */
     if (eventptr==NULL)
-      goto terminate;
+      return;
+    nevents++;
     evlist = evlist->next;        /* remove this event from event list */
     if (evlist!=NULL)
       evlist->prev=NULL;
-    if (TRACE>=2) {
+    evcount--;
+    INSTR_QUEUE(eventptr->evtime, evcount);
+    if (TRACING(2)) {
       printf("\nEVENT time: %f,",eventptr->evtime);
       printf("  type: %d",eventptr->evtype);
       if (eventptr->evtype==0)
         printf(", timerinterrupt  ");
       else if (eventptr->evtype==1)
         printf(", fromlayer5 ");
-      else
+      else if (eventptr->evtype==2)
         printf(", fromlayer3 ");
+      else if (eventptr->evtype==3)
+        printf(", reorder timeout ");
+      else if (eventptr->evtype==4)
+        printf(", hop to %s ", topo.names[eventptr->node]);
+      else
+        printf(", cross traffic ");
       printf(" entity: %d\n",eventptr->eventity);
     }
     time = eventptr->evtime;        /* update time to next event time */
-    if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
-        generate_next_arrival();   /* set up future arrival */
-        /* fill in msg to give with string of same letter */    
-        j = nsim % 26; 
-        for (i=0; i<20; i++)  
-          msg2give.data[i] = 97 + j;
-        if (TRACE>2) {
-          printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
-          printf("\n");
-        }
-        nsim++;
-        if (eventptr->eventity == A) 
-          A_output(msg2give);  
-        else
-          B_output(msg2give);  
-      }
-      else if (TRACE > 2)
-          printf("          FROM_LAYER5: no more messages to send: \n");
-    }
-    else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-        A_input(pkt2give);            /* appropriate entity */
+    checkwarmup();
+    INSTR_START(evmark);
+    if (eventptr->evtype == HOP || eventptr->evtype == CROSS_ARRIVAL) {
+      if (eventptr->evtype == CROSS_ARRIVAL || eventptr->source >= 0)
+        ncrossev--;
+      if (eventptr->evtype == HOP)
+        reached(eventptr);
       else
-        B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
+        crossarrival(eventptr);
+      INSTR_STOP(IN_EV_FROM_LAYER3, evmark);
+      continue;
+    }
+    if (eventptr->evtype ==  FROM_LAYER3 && npaths > 0) {
+      resequence(eventptr);
+      INSTR_STOP(IN_EV_FROM_LAYER3, evmark);
+      continue;
     }
+    if (eventptr->evtype ==  FROM_LAYER3)
+      handup(eventptr);
+    else if (eventptr->evtype == RESEQ_TIMEOUT)
+      flush(&reseqs[eventptr->eventity], eventptr->pktseq);
     else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
-        A_timerinterrupt();
-      else
-        B_timerinterrupt();
+      if (eventptr->eventity == A) {
+        INSTR_START(cbmark);
+        proto->A_timerinterrupt(instance);
+        INSTR_STOP(IN_A_TIMER, cbmark);
+      }
+      else {
+        INSTR_START(cbmark);
+        proto->B_timerinterrupt(instance);
+        INSTR_STOP(IN_B_TIMER, cbmark);
+      }
     }
     else  {
       printf("INTERNAL PANIC: unknown event type \n");
     }
+    INSTR_STOP(eventptr->evtype == RESEQ_TIMEOUT ? IN_EV_FROM_LAYER3 :
+               IN_EV_TIMER + eventptr->evtype, evmark);
+    INSTR_START(freemark);
     free(eventptr);
+    INSTR_STOP(IN_FREE, freemark);
   }
+}
+
+static void report(void)
+{
+  int i, j;
 
- terminate:
   printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
   printf("number of messages dropped due to full window:  %d \n", window_full);
   printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
   printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
   printf("number of packet resends by A:  %d \n", packets_resent);
+  printf("number of timeout recoveries at A:  %d, mean recovery time:  %f \n", recoveries,
+         recoveries ? recovery_time / recoveries : 0.0);
+  if (nacks_sent > 0 || nacks_suppressed > 0) {
+    printf("number of NACKs sent by B:  %d (%d more suppressed), packets resent on a NACK:  %d \n",
+           nacks_sent, nacks_suppressed, nack_resends);
+    printf("number of NACK recoveries at A:  %d, mean recovery time:  %f \n", nack_recoveries,
+           nack_recoveries ? nack_recovery_time / nack_recoveries : 0.0);
+  }
+  if (fec_parity_sent > 0) {
+    printf("number of FEC parity packets sent by A:  %d (%.1f%% of data packets), packets rebuilt at B:  %d \n",
+           fec_parity_sent, npackets[A] > fec_parity_sent ?
+           100.0 * fec_parity_sent / (npackets[A] - fec_parity_sent) : 0.0, fec_rebuilt);
+    printf("number of retransmissions avoided (rebuilt packets A never had to resend):  %d \n",
+           fec_resends_avoided);
+    printf("mean delivery latency:  %f \n", latencyn ? latencysum / latencyn : 0.0);
+  }
+  if (conf.backlog_capacity > 0 || conf.backlog_block) {
+    printf("number of messages queued in A's backlog:  %d, longest backlog:  %d \n", messages_queued, backlog_max);
+    printf("mean backlog length:  %f, mean queueing delay:  %f, longest:  %f \n",
+           time > 0 ? backlog_area / time : 0.0,
+           messages_queued ? queue_delay / messages_queued : 0.0, queue_delay_max);
+  }
   printf("number of correct packets received at B:  %d \n", packets_received);
   printf("number of messages delivered to application:  %d \n", messages_delivered);
+  for (i = 0; i < nsources; i++)
+    arrival_report(&sources[i], i);
+  if (xfermode) {
+    xfer_finish(&xfer);
+    xfer_report(&xfer, time, metrics_clock() - wallstart);
+  }
+  if (topology)
+    topo_report(&topo, time);
+  else if (npaths == 0)
+    for (i = A; i <= B; i++)
+      channel_report(&channels[i], i);
+  else {
+    printf("multipath (%s, reorder timeout %g): aggregate goodput %f\n", sched_name(scheduler),
+           reorder, time > 0 ? messages_delivered / time : 0.0);
+    for (i = A; i <= B; i++)
+      for (j = 0; j < npaths; j++)
+        path_report(&paths[i][j], j, i, time);
+    for (i = A; i <= B; i++)
+      printf("resequencing at %s: %d packets waited, mean wait %f, longest %f; "
+             "%d given up on, %d late, %d duplicates\n", i == A ? "A" : "B", reseqs[i].nheld,
+             reseqs[i].nheld ? reseqs[i].holdtime / reseqs[i].nheld : 0.0, reseqs[i].holdmax,
+             reseqs[i].skipped, reseqs[i].late, reseqs[i].duplicates);
+  }
+  INSTR_REPORT(instrjson);
+}
+
+/* one replication, in a child of replicate() */
+static void replication(unsigned s, double *v)
+{
+  seed = s;
+  reset();
+  instance = proto->create(&conf);
+  proto->A_init(instance);
+  proto->B_init(instance);
+  simulate();
+
+  v[REP_GOODPUT] = warmed && time > warmtime ?
+    (messages_delivered - warmdelivered) / (time - warmtime) : 0.0;
+  v[REP_RESENDS] = npackets[A] > warmsent ?
+    (double)(packets_resent - warmresent) / (npackets[A] - warmsent) : 0.0;
+  v[REP_LATENCY] = latencyn ? latencysum / latencyn : 0.0;
+}
+
+/* the runs side by side, when there was more than one */
+static void compare(void)
+{
+  struct result *r;
+  int i;
+
+  printf("\nprotocol      delivered        time   goodput     sent  resent  resent%%  recoveries  mean recovery   nacks  parity  rebuilt   latency\n");
+  for (i = 0; i < nruns; i++) {
+    r = &results[i];
+    printf("%-12s %10d %11.2f %9.5f %8d %7d %7.1f%% %11d %14.3f %7d %7d %8d %9.3f\n", runlist[i]->name,
+           r->delivered, r->time, r->time > 0 ? r->delivered / r->time : 0.0,
+           r->sent, r->resent, r->sent ? 100.0 * r->resent / r->sent : 0.0,
+           r->recoveries, r->recoveries ? r->recovery_time / r->recoveries : 0.0, r->nacks,
+           r->parity, r->rebuilt, r->latency);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int run;
+
+  parseargs(argc, argv);
+  if (metricsdest != NULL)
+    metrics_open(metricsdest, metricsformat);
+  init();
+  if (replicating) {
+    TRACE = 0;          /* the runs are in parallel: no traces */
+    repconf.seed = seed;
+    for (run = 0; run < nruns; run++) {
+      proto = runlist[run];
+      printf("\n===== %s: %s =====\n", proto->name, proto->description);
+      replicate(&repconf, replication);
+    }
+    return EXIT_SUCCESS;
+  }
+  for (run = 0; run < nruns; run++) {
+    proto = runlist[run];
+    if (nruns > 1)
+      printf("\n===== %s: %s =====\n", proto->name, proto->description);
+    runno = run;
+    reset();
+    instance = proto->create(&conf);
+    proto->A_init(instance);
+    proto->B_init(instance);
+    simulate();
+    report();
+    if (metricsdest != NULL)
+      snapshot("final");
+
+    results[run].delivered = messages_delivered;
+    results[run].time = time;
+    results[run].sent = npackets[A];
+    results[run].resent = packets_resent;
+    results[run].recoveries = recoveries + nack_recoveries;
+    results[run].recovery_time = recovery_time + nack_recovery_time;
+    results[run].nacks = nacks_sent;
+    results[run].parity = fec_parity_sent;
+    results[run].rebuilt = fec_rebuilt;
+    results[run].latency = latencyn ? latencysum / latencyn : 0.0;
+    proto->destroy(instance);
+  }
+  if (nruns > 1)
+    compare();
+  metrics_close();
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
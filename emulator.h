@@ -1,11 +1,41 @@
 extern int TRACE;
 
+/* trace output of level n is printed when TRACE >= n.  Levels above
+   TRACE_MAX are compiled out, tests and format strings included; the
+   default keeps all of them (4 is the highest used).  A release build
+   for long sweeps, with no trace code in the event loop at all:
+     gcc -O2 -DTRACE_MAX=0 ...
+*/
+#ifndef TRACE_MAX
+#define TRACE_MAX 4
+#endif
+#ifdef __GNUC__
+#define TRACING(n) (TRACE_MAX >= (n) && __builtin_expect(TRACE >= (n), 0))
+#else
+#define TRACING(n) (TRACE_MAX >= (n) && TRACE >= (n))
+#endif
+
 /* statistics updated by GBN */
 extern int total_ACKs_received;
 extern int packets_resent;       /* count of the number of packets resent  */
 extern int new_ACKs;      /* count of the number of acks correctly received */
 extern int packets_received;  /* count of the packets received by receiver */
 extern int window_full; /* count of the number of messages dropped due to full window */
+extern int recoveries;    /* count of timeout recoveries (timeout until the window moves) */
+extern double recovery_time;  /* total time spent in those recoveries */
+extern int messages_queued;   /* count of messages that waited in A's backlog */
+extern double queue_delay;    /* total time they waited */
+extern double queue_delay_max;  /* longest wait */
+extern int backlog_max;       /* longest the backlog has been */
+extern double backlog_area;   /* backlog length integrated over time */
+extern int nacks_sent;        /* count of NACKs sent by B */
+extern int nacks_suppressed;  /* count of gaps not NACKed because one was recent */
+extern int nack_resends;      /* count of packets resent on a NACK */
+extern int nack_recoveries;   /* count of recoveries started by a NACK */
+extern double nack_recovery_time;  /* total time spent in those recoveries */
+extern int fec_parity_sent;   /* count of FEC parity packets sent by A */
+extern int fec_rebuilt;       /* count of packets B rebuilt from parity */
+extern int fec_resends_avoided;  /* of those, the ones A never had to resend */
 
 #define   A    0
 #define   B    1
@@ -38,3 +68,13 @@ extern void starttimer(int, double);
 
 /* stop timer at A or B (int) */
 extern void stoptimer(int);               
+
+/* flow control: stop or restart the messages from layer 5 at A or B (int) */
+extern void stoplayer5(int);
+extern void startlayer5(int);
+
+/* current simulation time */
+extern double gettime(void);
+
+/* uniform random number in [0,1]; the emulator's only source of randomness */
+extern double jimsrand(void);
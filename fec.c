@@ -0,0 +1,172 @@
+/* ******************************************************************
+   XOR and Reed-Solomon erasure codes.  See fec.h.
+**********************************************************************/
+#include <string.h>
+#include "fec.h"
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#define GF_POLY 0x11d   /* x^8 + x^4 + x^3 + x^2 + 1 */
+#define MAXLEN  256     /* longest block fec_decode() takes */
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+static uint8_t mul_lo[256][16];   /* c * n and c * (n << 4), for every */
+static uint8_t mul_hi[256][16];   /* c and every nibble n */
+static int ready;
+
+static void gf_init(void)
+{
+  int i, n, x = 1;
+
+  for (i = 0; i < 255; i++) {
+    gf_exp[i] = gf_exp[i + 255] = x;
+    gf_log[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= GF_POLY;
+  }
+  gf_exp[510] = gf_exp[511] = gf_exp[0];
+  for (i = 0; i < 256; i++)
+    for (n = 0; n < 16; n++) {
+      mul_lo[i][n] = i && n ? gf_exp[gf_log[i] + gf_log[n]] : 0;
+      mul_hi[i][n] = i && n ? gf_exp[gf_log[i] + gf_log[n << 4]] : 0;
+    }
+  ready = 1;
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+  return a && b ? gf_exp[gf_log[a] + gf_log[b]] : 0;
+}
+
+static uint8_t gf_inv(uint8_t a)
+{
+  return gf_exp[255 - gf_log[a]];
+}
+
+/* generator row j, column i: all ones for XOR, else 1 / (x_j + y_i)
+   with x_j = k + j and y_i = i, which are all distinct */
+static uint8_t coef(int k, int m, int j, int i)
+{
+  if (m == 1)
+    return 1;
+  return gf_inv((uint8_t)((k + j) ^ i));
+}
+
+/* dst += c * src over len bytes */
+static void muladd(uint8_t *dst, const uint8_t *src, uint8_t c, int len)
+{
+  int i = 0;
+
+  if (c == 0)
+    return;
+#ifdef __SSSE3__
+  {
+    __m128i lo = _mm_loadu_si128((const __m128i *)mul_lo[c]);
+    __m128i hi = _mm_loadu_si128((const __m128i *)mul_hi[c]);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i s, d, p;
+
+    for (; i + 16 <= len; i += 16) {
+      s = _mm_loadu_si128((const __m128i *)(src + i));
+      d = _mm_loadu_si128((const __m128i *)(dst + i));
+      p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                        _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, p));
+    }
+  }
+#endif
+  if (c == 1)
+    for (; i < len; i++)
+      dst[i] ^= src[i];
+  else
+    for (; i < len; i++)
+      dst[i] ^= mul_lo[c][src[i] & 0x0f] ^ mul_hi[c][src[i] >> 4];
+}
+
+void fec_encode(int k, int m, const uint8_t *const *data, uint8_t *const *parity, int len)
+{
+  int i, j;
+
+  if (!ready)
+    gf_init();
+  for (j = 0; j < m; j++) {
+    memset(parity[j], 0, len);
+    for (i = 0; i < k; i++)
+      muladd(parity[j], data[i], coef(k, m, j, i), len);
+  }
+}
+
+int fec_decode(int k, int m, uint8_t *const *data, const int *have,
+               const uint8_t *const *parity, const int *phave, int len)
+{
+  int miss[FEC_MAXM], use[FEC_MAXM];
+  uint8_t a[FEC_MAXM][FEC_MAXM], inv[FEC_MAXM][FEC_MAXM];
+  uint8_t syn[FEC_MAXM][MAXLEN];
+  uint8_t t;
+  int e = 0, p = 0, i, j, r, c;
+
+  if (!ready)
+    gf_init();
+  for (i = 0; i < k; i++)
+    if (!have[i]) {
+      if (e == m)
+        return -1;
+      miss[e++] = i;
+    }
+  if (e == 0)
+    return 0;
+  for (j = 0; j < m && p < e; j++)
+    if (phave[j])
+      use[p++] = j;
+  if (p < e || len > MAXLEN)
+    return -1;
+
+  /* syndromes: each parity block minus what the data we have put in it */
+  for (r = 0; r < e; r++) {
+    memcpy(syn[r], parity[use[r]], len);
+    for (i = 0; i < k; i++)
+      if (have[i])
+        muladd(syn[r], data[i], coef(k, m, use[r], i), len);
+  }
+
+  /* invert the e x e part of the generator for the missing blocks */
+  for (r = 0; r < e; r++)
+    for (c = 0; c < e; c++) {
+      a[r][c] = coef(k, m, use[r], miss[c]);
+      inv[r][c] = r == c;
+    }
+  for (c = 0; c < e; c++) {
+    for (r = c; r < e && a[r][c] == 0; r++)
+      ;
+    if (r == e)
+      return -1;        /* cannot happen for a Cauchy matrix */
+    for (j = 0; j < e; j++) {
+      t = a[c][j]; a[c][j] = a[r][j]; a[r][j] = t;
+      t = inv[c][j]; inv[c][j] = inv[r][j]; inv[r][j] = t;
+    }
+    t = gf_inv(a[c][c]);
+    for (j = 0; j < e; j++) {
+      a[c][j] = gf_mul(a[c][j], t);
+      inv[c][j] = gf_mul(inv[c][j], t);
+    }
+    for (r = 0; r < e; r++)
+      if (r != c && a[r][c] != 0) {
+        t = a[r][c];
+        for (j = 0; j < e; j++) {
+          a[r][j] ^= gf_mul(a[c][j], t);
+          inv[r][j] ^= gf_mul(inv[c][j], t);
+        }
+      }
+  }
+
+  for (c = 0; c < e; c++) {
+    memset(data[miss[c]], 0, len);
+    for (r = 0; r < e; r++)
+      muladd(data[miss[c]], syn[r], inv[c][r], len);
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef FEC_H
+#define FEC_H
+
+/* ******************************************************************
+   Erasure codes for forward error correction.
+
+   A group of k data blocks gets m parity blocks.  With m = 1 the
+   parity is the plain XOR of the data; with m > 1 it is a systematic
+   Reed-Solomon code over GF(2^8) with a Cauchy generator matrix, so
+   any m lost blocks of the group can be rebuilt from the rest.  The
+   inner loops multiply a whole block by a constant at once, 16 bytes
+   per SSSE3 shuffle when the compiler targets it (-mssse3 or
+   -march=native), and byte by byte otherwise.
+**********************************************************************/
+
+#include <stdint.h>
+
+#define FEC_MAXK 16     /* data blocks per group */
+#define FEC_MAXM 4      /* parity blocks per group */
+
+/* fill parity[0..m-1] (len bytes each) from data[0..k-1] */
+extern void fec_encode(int k, int m, const uint8_t *const *data, uint8_t *const *parity, int len);
+
+/* rebuild the data blocks with have[i] == 0 from the others and the
+   parity blocks with phave[j] != 0.  Returns 0, or -1 if more blocks
+   are missing than there are parity blocks. */
+extern int fec_decode(int k, int m, uint8_t *const *data, const int *have,
+                      const uint8_t *const *parity, const int *phave, int len);
+
+#endif
@@ -1,8 +1,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "emulator.h"
+#include "protocol.h"
+#include "checksum.h"
 #include "gbn.h"
+#include "fec.h"
+#include "backlog.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -20,6 +25,17 @@
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
    - added GBN implementation
+   - added optional selective acknowledgements (sack): B buffers
+   out-of-order packets and reports them in the ACK payload, and A
+   resends only the packets B has not reported on a timeout
+   - all state lives in a struct gbn instance, reached through the
+   protocol table at the end of this file
+   - added optional negative acknowledgements (nack): B asks for the
+   missing packets as soon as it sees a gap, and A resends them at once
+   instead of waiting for the timer
+   - added optional forward error correction (fec): after every k new
+   packets A sends m parity packets, from which B rebuilds up to m lost
+   or corrupted packets of the group without a retransmission
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
@@ -28,109 +44,284 @@
 #define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
 
+/* With SACK the receiver accepts a whole window of packets out of order,
+   and with NACK it must tell a packet from beyond a gap from an old
+   duplicate, so sequence numbers must not repeat within two windows. */
+#define SACKSEQSPACE (2*WINDOWSIZE)
+
+/* A NACK is an ACK (same cumulative acknum) with NACKMARK as the last
+   payload character; the one before it holds '0' plus the number of
+   packets after acknum that B is missing.  B sends at most one NACK per
+   gap every NACKINTERVAL, and A does not resend a packet on a NACK if
+   it resent it less than NACKINTERVAL ago, so a burst of out-of-order
+   arrivals cannot start a NACK storm. */
+#define NACKMARK 'N'
+#define NACKINTERVAL RTT
+
+/* A parity packet has the sequence number of the first packet of its
+   group and FECPARITY - j as acknum, j being its index in the group.
+   B must hold the group's packets until the parity arrives, so FEC
+   implies SACK, and groups are at most a window long.  An ACK also
+   reports which of the last WINDOWSIZE packets up to acknum B rebuilt
+   from parity, as SACK-style bits FECBITS + i for packet acknum - i;
+   A counts a retransmission avoided when such a packet leaves its
+   window without having been resent. */
+#define FECPARITY (-2)
+#define FECBITS SACKSEQSPACE    /* past any SACK offset A may look at */
+
+struct gbn {
+  bool sack;                      /* selective acknowledgements */
+  int seqspace;                   /* SEQSPACE, or SACKSEQSPACE with SACK or NACK */
+  bool nack;                      /* negative acknowledgements */
+  int fec_k, fec_m;               /* FEC: k packets per group, m parity; 0 = off */
+
+  /* Sender (A) */
+  struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+  int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
+  int windowcount;                /* the number of packets currently awaiting an ACK */
+  int A_nextseqnum;               /* the next sequence number to be used by the sender */
+  bool sacked[WINDOWSIZE];        /* buffered packet is known to be held by B */
+  double resenttime[WINDOWSIZE];  /* when each buffered packet was last resent */
+  double recoverystart;           /* when the current recovery began */
+  bool recovering;                /* a loss was detected and the window has not moved */
+  bool nackrecovery;              /* ... and a NACK detected it, not the timer */
+  int fecn;                       /* new packets sent in the current FEC group */
+  int fecfirst;                   /* and the sequence number of its first */
+  char fecdata[FEC_MAXK][20];     /* and their payloads */
+
+  struct backlog backlog;         /* messages waiting for room in the window */
+
+  /* Receiver (B) */
+  int expectedseqnum;             /* the sequence number expected next by the receiver */
+  int B_nextseqnum;               /* the sequence number for the next packets sent by B */
+  struct pkt rcvbuffer[WINDOWSIZE]; /* with SACK: out-of-order packets, by seqnum % WINDOWSIZE */
+  bool rcvbuffered[WINDOWSIZE];
+  int nackseq;                    /* expectedseqnum when the last NACK was sent */
+  double nacktime;                /* and when, or -1 before the first */
+  char fechist[SACKSEQSPACE][20]; /* FEC: payloads of recently received packets, */
+  bool fechave[SACKSEQSPACE];     /* by sequence number */
+  bool fecrebuilt[SACKSEQSPACE];  /* and whether B rebuilt it from parity */
+  int fecgroup;                   /* group whose parity is in fecpar, or -1 */
+  char fecpar[FEC_MAXM][20];
+  bool fecparhave[FEC_MAXM];
+};
+
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
    original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
+   the packet is corrupted.  Which function is used is chosen with --checksum (see
+   checksum.h); the packet is read in place rather than copied.
 */
-int ComputeChecksum(struct pkt packet)
+static int ComputeChecksum(const struct pkt *packet)
 {
-  int checksum = 0;
-  int i;
-
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ )
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
+  return pkt_checksum(packet);
 }
 
-bool IsCorrupted(struct pkt packet)
+static bool IsCorrupted(const struct pkt *packet)
 {
-  if (packet.checksum == ComputeChecksum(packet))
+  if (packet->checksum == ComputeChecksum(packet))
     return (false);
   else
     return (true);
 }
 
+/* SACK blocks travel in the ACK payload, which is otherwise all '0's.
+   Each payload character carries four bits of a bitmap on top of '0';
+   bit i reports that B holds the packet with sequence number
+   acknum + 1 + i.  An ACK without SACK information is therefore just
+   an empty bitmap. */
+static void SetSackBit(struct pkt *packet, int i)
+{
+  packet->payload[i / 4] = '0' + ((packet->payload[i / 4] - '0') | (1 << (i % 4)));
+}
+
+static bool SackBit(struct pkt *packet, int i)
+{
+  int nibble = packet->payload[i / 4] - '0';
+
+  if (nibble < 0 || nibble > 15)
+    return (false);
+  return ((nibble >> (i % 4)) & 1);
+}
+
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+/* the current FEC group is complete: send its parity packets */
+static void SendParity(struct gbn *g)
+{
+  const uint8_t *data[FEC_MAXK];
+  uint8_t *parity[FEC_MAXM];
+  struct pkt sendpkt[FEC_MAXM];
+  int i, j;
+
+  for (i=0; i<g->fec_k; i++)
+    data[i] = (const uint8_t *)g->fecdata[i];
+  for (j=0; j<g->fec_m; j++)
+    parity[j] = (uint8_t *)sendpkt[j].payload;
+  fec_encode(g->fec_k, g->fec_m, data, parity, 20);
+
+  for (j=0; j<g->fec_m; j++) {
+    sendpkt[j].seqnum = g->fecfirst;
+    sendpkt[j].acknum = FECPARITY - j;
+    sendpkt[j].checksum = ComputeChecksum(&sendpkt[j]);
+    if (TRACING(1))
+      printf("Sending parity packet %d for packets from %d to layer 3\n", j, g->fecfirst);
+    tolayer3 (A, sendpkt[j]);
+    fec_parity_sent++;
+  }
+  g->fecn = 0;
+}
 
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+/* put a new message into the window and send it */
+static void SendNewPacket(struct gbn *g, struct msg message)
 {
   struct pkt sendpkt;
   int i;
 
+  /* create packet */
+  sendpkt.seqnum = g->A_nextseqnum;
+  sendpkt.acknum = NOTINUSE;
+  for ( i=0; i<20 ; i++ )
+    sendpkt.payload[i] = message.data[i];
+  sendpkt.checksum = ComputeChecksum(&sendpkt);
+
+  /* put packet in window buffer */
+  /* windowlast will always be 0 for alternating bit; but not for GoBackN */
+  g->windowlast = (g->windowlast + 1) % WINDOWSIZE;
+  g->buffer[g->windowlast] = sendpkt;
+  g->sacked[g->windowlast] = false;
+  g->resenttime[g->windowlast] = -NACKINTERVAL;
+  g->windowcount++;
+
+  /* send out packet */
+  if (TRACING(1))
+    printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+  tolayer3 (A, sendpkt);
+
+  /* start timer if first packet in window */
+  if (g->windowcount == 1)
+    starttimer(A,RTT);
+
+  /* get next sequence number, wrap back to 0 */
+  g->A_nextseqnum = (g->A_nextseqnum + 1) % g->seqspace;
+
+  /* with FEC, the packet joins the current group */
+  if (g->fec_k > 0) {
+    if (g->fecn == 0)
+      g->fecfirst = sendpkt.seqnum;
+    memcpy(g->fecdata[g->fecn++], sendpkt.payload, 20);
+    if (g->fecn == g->fec_k)
+      SendParity(g);
+  }
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void A_output(void *self, struct msg message)
+{
+  struct gbn *g = self;
+
   /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
+  if ( g->windowcount < WINDOWSIZE) {
+    if (TRACING(2))
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ )
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE;
-    buffer[windowlast] = sendpkt;
-    windowcount++;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
-
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
-
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    SendNewPacket(g, message);
+  }
+  /* window is full, but the message can wait in the backlog */
+  else if (backlog_put(&g->backlog, message) == 0) {
+    if (TRACING(1))
+      printf("----A: New message arrives, send window is full, queue it\n");
   }
   /* if blocked,  window is full */
   else {
-    if (TRACE > 0)
+    if (TRACING(1))
       printf("----A: New message arrives, send window is full\n");
     window_full++;
   }
+  backlog_pressure(&g->backlog, g->windowcount == WINDOWSIZE);
+}
+
+/* move queued messages into the window as far as it has room */
+static void DrainBacklog(struct gbn *g)
+{
+  struct msg message;
+
+  while (g->windowcount < WINDOWSIZE && backlog_get(&g->backlog, &message) == 0) {
+    if (TRACING(2))
+      printf("----A: window has room, send queued message to layer3!\n");
+    SendNewPacket(g, message);
+  }
+  backlog_pressure(&g->backlog, g->windowcount == WINDOWSIZE);
 }
 
 
+/* B is missing packets after packet.acknum: resend them now.  Without
+   SACK, B has thrown away everything after the gap, so that is the
+   whole window; with SACK only the ones it named and does not hold. */
+static void ResendOnNack(struct gbn *g, struct pkt packet)
+{
+  int count = packet.payload[18] - '0';
+  int i, slot;
+  bool resent = false;
+
+  /* a stale NACK, from before the window last moved */
+  if (g->windowcount == 0 || g->buffer[g->windowfirst].seqnum != (packet.acknum + 1) % g->seqspace)
+    return;
+  if (TRACING(1))
+    printf("----A: NACK for %d packet(s) after %d is received\n", count, packet.acknum);
+  if (!g->sack || count > g->windowcount)
+    count = g->windowcount;
+
+  for (i=0; i<count; i++) {
+    slot = (g->windowfirst+i) % WINDOWSIZE;
+    if ((g->sack && g->sacked[slot]) || gettime() - g->resenttime[slot] < NACKINTERVAL)
+      continue;
+    if (TRACING(1))
+      printf ("---A: resending packet %d\n", g->buffer[slot].seqnum);
+    tolayer3(A, g->buffer[slot]);
+    g->resenttime[slot] = gettime();
+    packets_resent++;
+    nack_resends++;
+    resent = true;
+  }
+  if (!resent)
+    return;
+
+  if (!g->recovering) {
+    g->recovering = true;
+    g->nackrecovery = true;
+    g->recoverystart = gettime();
+  }
+  /* give the resent packets a full timeout */
+  stoptimer(A);
+  starttimer(A, RTT);
+}
+
 /* called from layer 3, when a packet arrives for layer 4
    In this practical this will always be an ACK as B never sends data.
 */
-void A_input(struct pkt packet)
+static void A_input(void *self, struct pkt packet)
 {
+  struct gbn *g = self;
   int ackcount = 0;
   int i;
 
   /* if received ACK is not corrupted */
-  if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
+  if (!IsCorrupted(&packet)) {
+    if (TRACING(1))
       printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
     total_ACKs_received++;
 
     /* check if new ACK or duplicate */
-    if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
+    if (g->windowcount != 0) {
+          int seqfirst = g->buffer[g->windowfirst].seqnum;
+          int seqlast = g->buffer[g->windowlast].seqnum;
           /* check case when seqnum has and hasn't wrapped */
           if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
               ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
 
             /* packet is a new ACK */
-            if (TRACE > 0)
+            if (TRACING(1))
               printf("----A: ACK %d is not a duplicate\n",packet.acknum);
             new_ACKs++;
 
@@ -138,45 +329,95 @@ void A_input(struct pkt packet)
             if (packet.acknum >= seqfirst)
               ackcount = packet.acknum + 1 - seqfirst;
             else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
+              ackcount = g->seqspace - seqfirst + packet.acknum;
+
+            /* packets B reports rebuilt from parity, acknowledged
+               without a resend, each saved one */
+            if (g->fec_k > 0)
+              for (i=0; i<ackcount; i++) {
+                int slot = (g->windowfirst+i) % WINDOWSIZE;
+                int back = (packet.acknum - g->buffer[slot].seqnum + g->seqspace) % g->seqspace;
+                if (back < WINDOWSIZE && SackBit(&packet, FECBITS + back) && g->resenttime[slot] < 0)
+                  fec_resends_avoided++;
+              }
 
 	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
+            g->windowfirst = (g->windowfirst + ackcount) % WINDOWSIZE;
 
             /* delete the acked packets from window buffer */
             for (i=0; i<ackcount; i++)
-              windowcount--;
+              g->windowcount--;
+
+            /* the window moved, so any recovery is over */
+            if (g->recovering && g->nackrecovery) {
+              nack_recoveries++;
+              nack_recovery_time += gettime() - g->recoverystart;
+            }
+            else if (g->recovering) {
+              recoveries++;
+              recovery_time += gettime() - g->recoverystart;
+            }
+            g->recovering = false;
 
 	    /* start timer again if there are still more unacked packets in window */
             stoptimer(A);
-            if (windowcount > 0)
+            if (g->windowcount > 0)
               starttimer(A, RTT);
 
+            /* the window moved: send what has been waiting */
+            DrainBacklog(g);
+
           }
         }
         else
-          if (TRACE > 0)
+          if (TRACING(1))
         printf ("----A: duplicate ACK received, do nothing!\n");
+
+    /* note which packets beyond the cumulative ACK B already holds */
+    if (g->sack)
+      for (i=0; i<g->windowcount; i++) {
+        int slot = (g->windowfirst+i) % WINDOWSIZE;
+        int offset = (g->buffer[slot].seqnum - packet.acknum - 1 + g->seqspace) % g->seqspace;
+        if (SackBit(&packet, offset))
+          g->sacked[slot] = true;
+      }
+
+    if (g->nack && packet.payload[19] == NACKMARK)
+      ResendOnNack(g, packet);
   }
   else
-    if (TRACE > 0)
+    if (TRACING(1))
       printf ("----A: corrupted ACK is received, do nothing!\n");
 }
 
 /* called when A's timer goes off */
-void A_timerinterrupt(void)
+static void A_timerinterrupt(void *self)
 {
+  struct gbn *g = self;
   int i;
 
-  if (TRACE > 0)
+  if (TRACING(1))
     printf("----A: time out,resend packets!\n");
 
-  for(i=0; i<windowcount; i++) {
+  if (!g->recovering && g->windowcount > 0) {
+    g->recovering = true;
+    g->nackrecovery = false;
+    g->recoverystart = gettime();
+  }
+
+  for(i=0; i<g->windowcount; i++) {
 
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
+    /* with SACK, skip the packets B has reported holding */
+    if (g->sack && g->sacked[(g->windowfirst+i) % WINDOWSIZE]) {
+      if (i==0) starttimer(A,RTT);
+      continue;
+    }
 
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
+    if (TRACING(1))
+      printf ("---A: resending packet %d\n", (g->buffer[(g->windowfirst+i) % WINDOWSIZE]).seqnum);
+
+    tolayer3(A,g->buffer[(g->windowfirst+i) % WINDOWSIZE]);
+    g->resenttime[(g->windowfirst+i) % WINDOWSIZE] = gettime();
     packets_resent++;
     if (i==0) starttimer(A,RTT);
   }
@@ -186,67 +427,212 @@ void A_timerinterrupt(void)
 
 /* the following routine will be called once (only) before any other */
 /* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+static void A_init(void *self)
 {
+  struct gbn *g = self;
+
   /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.
+  g->A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  g->windowfirst = 0;
+  g->windowlast = -1;   /* windowlast is where the last packet sent is stored.
 		     new packets are placed in winlast + 1
 		     so initially this is set to -1
 		   */
-  windowcount = 0;
+  g->windowcount = 0;
+  g->recovering = false;
+
+  backlog_reset(&g->backlog);
+  g->fecn = 0;
 }
 
 
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+static void B_input(void *self, struct pkt packet);
+
+/* B received packet seqnum (or delivered it): keep it for FEC */
+static void FecRecord(struct gbn *g, int seqnum, const char *payload)
+{
+  memcpy(g->fechist[seqnum], payload, 20);
+  g->fechave[seqnum] = true;
+}
+
+/* B's window moved past one more packet; the sequence number that just
+   came into the window was last used a generation ago, and so was any
+   parity kept for a group starting there */
+static void FecForget(struct gbn *g)
+{
+  int seq;
+
+  if (g->fec_k > 0) {
+    seq = (g->expectedseqnum + WINDOWSIZE - 1) % g->seqspace;
+    g->fechave[seq] = false;
+    g->fecrebuilt[seq] = false;
+    if (seq == g->fecgroup)
+      g->fecgroup = -1;
+  }
+}
 
+/* a parity packet arrived: rebuild what is missing from its group */
+static void FecParity(struct gbn *g, struct pkt packet)
+{
+  uint8_t *data[FEC_MAXK];
+  const uint8_t *parity[FEC_MAXM];
+  int have[FEC_MAXK], phave[FEC_MAXM];
+  struct pkt rebuilt;
+  int first = packet.seqnum, start, i, j, seq, missing = 0;
+
+  /* where the group starts relative to B's window; packets up to a
+     window behind it are still in fechist */
+  start = (first - g->expectedseqnum + g->seqspace) % g->seqspace;
+  if (start > g->seqspace - WINDOWSIZE)
+    start -= g->seqspace;
+  if (start + g->fec_k <= 0 || start + g->fec_k > WINDOWSIZE)
+    return;             /* all delivered already, or cannot be ours */
+
+  if (first != g->fecgroup) {
+    g->fecgroup = first;
+    for (j=0; j<g->fec_m; j++)
+      g->fecparhave[j] = false;
+  }
+  j = FECPARITY - packet.acknum;
+  memcpy(g->fecpar[j], packet.payload, 20);
+  g->fecparhave[j] = true;
+
+  for (i=0; i<g->fec_k; i++) {
+    seq = (first + i) % g->seqspace;
+    data[i] = (uint8_t *)g->fechist[seq];
+    have[i] = g->fechave[seq];
+    missing += !have[i];
+  }
+  for (j=0; j<g->fec_m; j++) {
+    parity[j] = (const uint8_t *)g->fecpar[j];
+    phave[j] = g->fecparhave[j];
+  }
+  if (missing == 0 || fec_decode(g->fec_k, g->fec_m, data, have, parity, phave, 20) != 0)
+    return;
+
+  /* hand the rebuilt packets to B as if they had arrived */
+  for (i=0; i<g->fec_k; i++)
+    if (!have[i]) {
+      rebuilt.seqnum = (first + i) % g->seqspace;
+      rebuilt.acknum = NOTINUSE;
+      memcpy(rebuilt.payload, data[i], 20);
+      rebuilt.checksum = ComputeChecksum(&rebuilt);
+      if (TRACING(1))
+        printf("----B: packet %d rebuilt from parity\n", rebuilt.seqnum);
+      fec_rebuilt++;
+      g->fecrebuilt[rebuilt.seqnum] = true;
+      B_input(g, rebuilt);
+    }
+}
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+static void B_input(void *self, struct pkt packet)
 {
+  struct gbn *g = self;
   struct pkt sendpkt;
-  int i;
+  int i, offset, missing = 0;
+
+  /* parity packets only feed FEC; they are not acknowledged */
+  if (g->fec_k > 0 && packet.acknum <= FECPARITY && packet.acknum > FECPARITY - g->fec_m) {
+    if (!IsCorrupted(&packet))
+      FecParity(g, packet);
+    return;
+  }
 
   /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
-    if (TRACE > 0)
+  if  ( (!IsCorrupted(&packet))  && (packet.seqnum == g->expectedseqnum) ) {
+    if (TRACING(1))
       printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
     packets_received++;
 
     /* deliver to receiving application */
     tolayer5(B, packet.payload);
-
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
+    if (g->fec_k > 0)
+      FecRecord(g, packet.seqnum, packet.payload);
 
     /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+    g->expectedseqnum = (g->expectedseqnum + 1) % g->seqspace;
+    FecForget(g);
+
+    /* with SACK, the packet may have filled a hole in front of buffered ones */
+    while (g->sack && g->rcvbuffered[g->expectedseqnum % WINDOWSIZE]) {
+      if (TRACING(1))
+        printf("----B: delivering buffered packet %d\n",g->expectedseqnum);
+      packets_received++;
+      tolayer5(B, g->rcvbuffer[g->expectedseqnum % WINDOWSIZE].payload);
+      g->rcvbuffered[g->expectedseqnum % WINDOWSIZE] = false;
+      g->expectedseqnum = (g->expectedseqnum + 1) % g->seqspace;
+      FecForget(g);
+    }
+
+    /* send an ACK for the received packet(s) */
+    sendpkt.acknum = (g->expectedseqnum + g->seqspace - 1) % g->seqspace;
   }
   else {
+    /* with SACK, keep an uncorrupted packet that is within the window */
+    offset = (packet.seqnum - g->expectedseqnum + g->seqspace) % g->seqspace;
+    if (g->sack && !IsCorrupted(&packet) && offset < WINDOWSIZE) {
+      if (TRACING(1))
+        printf("----B: packet %d is out of order, buffer it and send SACK!\n",packet.seqnum);
+      g->rcvbuffer[packet.seqnum % WINDOWSIZE] = packet;
+      g->rcvbuffered[packet.seqnum % WINDOWSIZE] = true;
+      if (g->fec_k > 0)
+        FecRecord(g, packet.seqnum, packet.payload);
+    }
     /* packet is corrupted or out of order resend last ACK */
-    if (TRACE > 0)
+    else if (TRACING(1))
       printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
+
+    /* a packet from beyond a gap: the ones in between are missing */
+    if (g->nack && !IsCorrupted(&packet) && offset > 0 && offset < WINDOWSIZE)
+      missing = g->sack ? offset : offset + 1;
+    if (g->expectedseqnum == 0)
+      sendpkt.acknum = g->seqspace - 1;
     else
-      sendpkt.acknum = expectedseqnum - 1;
+      sendpkt.acknum = g->expectedseqnum - 1;
   }
 
   /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
+  sendpkt.seqnum = g->B_nextseqnum;
+  g->B_nextseqnum = (g->B_nextseqnum + 1) % 2;
 
   /* we don't have any data to send.  fill payload with 0's */
   for ( i=0; i<20 ; i++ )
     sendpkt.payload[i] = '0';
 
+  /* with SACK, report the buffered packets beyond the cumulative ACK */
+  if (g->sack)
+    for (i=1; i<WINDOWSIZE; i++)
+      if (g->rcvbuffered[(g->expectedseqnum + i) % g->seqspace % WINDOWSIZE])
+        SetSackBit(&sendpkt, i);
+
+  /* with FEC, report the packets up to acknum that were rebuilt */
+  if (g->fec_k > 0)
+    for (i=0; i<WINDOWSIZE; i++)
+      if (g->fecrebuilt[(sendpkt.acknum - i + g->seqspace) % g->seqspace])
+        SetSackBit(&sendpkt, FECBITS + i);
+
+  /* turn the ACK into a NACK, unless this gap was NACKed recently */
+  if (missing > 0) {
+    if (g->nackseq == g->expectedseqnum && g->nacktime >= 0 &&
+        gettime() - g->nacktime < NACKINTERVAL)
+      nacks_suppressed++;
+    else {
+      if (TRACING(1))
+        printf("----B: gap before packet %d, send NACK!\n", packet.seqnum);
+      sendpkt.payload[18] = '0' + missing;
+      sendpkt.payload[19] = NACKMARK;
+      g->nackseq = g->expectedseqnum;
+      g->nacktime = gettime();
+      nacks_sent++;
+    }
+  }
+
   /* computer checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt);
+  sendpkt.checksum = ComputeChecksum(&sendpkt);
 
   /* send out packet */
   tolayer3 (B, sendpkt);
@@ -254,10 +640,21 @@ void B_input(struct pkt packet)
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+static void B_init(void *self)
 {
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
+  struct gbn *g = self;
+  int i;
+
+  g->expectedseqnum = 0;
+  g->B_nextseqnum = 1;
+  for (i=0; i<WINDOWSIZE; i++)
+    g->rcvbuffered[i] = false;
+  g->nacktime = -1;
+  for (i=0; i<SACKSEQSPACE; i++) {
+    g->fechave[i] = false;
+    g->fecrebuilt[i] = false;
+  }
+  g->fecgroup = -1;
 }
 
 /******************************************************************************
@@ -265,11 +662,107 @@ void B_init(void)
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+static void B_output(void *self, struct msg message)
 {
+  (void)self;
+  (void)message;
 }
 
 /* called when B's timer goes off */
-void B_timerinterrupt(void)
+static void B_timerinterrupt(void *self)
 {
+  (void)self;
 }
+
+/******************** protocol table entries *************************/
+
+static void *gbn_create(const struct protoconf *conf)
+{
+  struct gbn *g = calloc(1, sizeof(struct gbn));
+
+  if (g == NULL) {
+    printf("memory allocation for protocol failed.");
+    exit(EXIT_FAILURE);
+  }
+  g->sack = conf->sack;
+  g->nack = conf->nack;
+  g->fec_k = conf->fec_k;
+  g->fec_m = conf->fec_m > 0 ? conf->fec_m : 1;
+  if (g->fec_k > WINDOWSIZE) {
+    printf("FEC groups can be at most %d packets, the window size\n", WINDOWSIZE);
+    exit(EXIT_FAILURE);
+  }
+  if (g->fec_k > 0)
+    g->sack = true;     /* B must buffer the group until the parity comes */
+  g->seqspace = g->sack || g->nack ? SACKSEQSPACE : SEQSPACE;
+  backlog_create(&g->backlog, conf);
+  return g;
+}
+
+/* the same protocol with selective acknowledgements always on */
+static void *gbn_sack_create(const struct protoconf *conf)
+{
+  struct protoconf sackconf = *conf;
+
+  sackconf.sack = 1;
+  return gbn_create(&sackconf);
+}
+
+/* and with negative acknowledgements always on */
+static void *gbn_nack_create(const struct protoconf *conf)
+{
+  struct protoconf nackconf = *conf;
+
+  nackconf.nack = 1;
+  return gbn_create(&nackconf);
+}
+
+/* and with FEC, by default one XOR parity packet per 4 packets */
+static void *gbn_fec_create(const struct protoconf *conf)
+{
+  struct protoconf fecconf = *conf;
+
+  if (fecconf.fec_k == 0)
+    fecconf.fec_k = 4;
+  return gbn_create(&fecconf);
+}
+
+static void gbn_destroy(void *self)
+{
+  struct gbn *g = self;
+
+  backlog_destroy(&g->backlog);
+  free(g);
+}
+
+const struct protocol gbn_protocol = {
+  "gbn", "Go-Back-N",
+  gbn_create, gbn_destroy,
+  A_init, A_output, A_input, A_timerinterrupt,
+  B_init, B_output, B_input, B_timerinterrupt,
+  PROTO_SACK | PROTO_NACK | PROTO_FEC | PROTO_BACKLOG, WINDOWSIZE
+};
+
+const struct protocol gbn_sack_protocol = {
+  "gbn-sack", "Go-Back-N with selective acknowledgements",
+  gbn_sack_create, gbn_destroy,
+  A_init, A_output, A_input, A_timerinterrupt,
+  B_init, B_output, B_input, B_timerinterrupt,
+  PROTO_SACK | PROTO_NACK | PROTO_FEC | PROTO_BACKLOG, WINDOWSIZE
+};
+
+const struct protocol gbn_nack_protocol = {
+  "gbn-nack", "Go-Back-N with negative acknowledgements",
+  gbn_nack_create, gbn_destroy,
+  A_init, A_output, A_input, A_timerinterrupt,
+  B_init, B_output, B_input, B_timerinterrupt,
+  PROTO_SACK | PROTO_NACK | PROTO_FEC | PROTO_BACKLOG, WINDOWSIZE
+};
+
+const struct protocol gbn_fec_protocol = {
+  "gbn-fec", "Go-Back-N with SACK and forward error correction",
+  gbn_fec_create, gbn_destroy,
+  A_init, A_output, A_input, A_timerinterrupt,
+  B_init, B_output, B_input, B_timerinterrupt,
+  PROTO_SACK | PROTO_NACK | PROTO_FEC | PROTO_BACKLOG, WINDOWSIZE
+};
@@ -0,0 +1,255 @@
+/* ******************************************************************
+   Hot-path instrumentation: per-slot cycle accounting, optional
+   hardware counters and event-queue depth tracking.  See instrument.h.
+   Apart from the portable cycle counter, the whole file is empty
+   unless built with -DINSTRUMENT.
+**********************************************************************/
+#include "instrument.h"
+
+#if !defined(__x86_64__) && !defined(__i386__)
+#include <time.h>
+
+uint64_t instr_cycles(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#ifdef INSTRUMENT
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef INSTRUMENT_PERF
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define QSERIES 512     /* max number of (time, depth) samples kept */
+#define QBUCKETS 17     /* depth histogram buckets: 0, 1, 2-3, 4-7, ... */
+
+struct instr_slotstat {
+  uint64_t calls;
+  uint64_t cycles;      /* total cycles */
+  uint64_t maxcycles;   /* longest single call */
+  uint64_t hw[2];       /* total instructions, cache misses */
+};
+
+static const char *slotnames[IN_NSLOTS] = {
+  "ev_timer", "ev_fromlayer5", "ev_fromlayer3",
+  "A_output", "A_input", "A_timerinterrupt",
+  "B_output", "B_input", "B_timerinterrupt",
+  "insertevent", "tolayer3", "tolayer5", "starttimer", "stoptimer", "free"
+};
+
+static struct instr_slotstat slots[IN_NSLOTS];
+
+/* event queue depth */
+static uint64_t qsamples;          /* number of depth samples */
+static uint64_t qsum;              /* sum of sampled depths */
+static int qmax;                   /* deepest queue seen */
+static double qarea;               /* integral of depth over simulated time */
+static double qlasttime;
+static int qlastdepth;
+static uint64_t qhist[QBUCKETS];
+static float qseries_t[QSERIES];   /* depth over time, decimated as it fills */
+static int qseries_d[QSERIES];
+static int qseries_n;
+static uint64_t qstride = 1;       /* keep one sample every qstride events */
+
+#ifdef INSTRUMENT_PERF
+static int perf_fd = -1;           /* group leader: instructions */
+
+static int perf_open(uint64_t config, int group)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = (group == -1);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void perf_read(uint64_t hw[2])
+{
+  uint64_t buf[3];      /* nr, instructions, cache misses */
+
+  if (perf_fd < 0 || read(perf_fd, buf, sizeof(buf)) != sizeof(buf)) {
+    hw[0] = hw[1] = 0;
+    return;
+  }
+  hw[0] = buf[1];
+  hw[1] = buf[2];
+}
+#endif
+
+void instr_init(void)
+{
+  memset(slots, 0, sizeof(slots));
+  qsamples = qsum = 0;
+  qmax = qlastdepth = 0;
+  qarea = qlasttime = 0.0;
+  memset(qhist, 0, sizeof(qhist));
+  qseries_n = 0;
+  qstride = 1;
+
+#ifdef INSTRUMENT_PERF
+  if (perf_fd >= 0)
+    return;
+  perf_fd = perf_open(PERF_COUNT_HW_INSTRUCTIONS, -1);
+  if (perf_fd < 0 || perf_open(PERF_COUNT_HW_CACHE_MISSES, perf_fd) < 0) {
+    printf("Warning: perf_event_open failed, hardware counters disabled.\n");
+    if (perf_fd >= 0)
+      close(perf_fd);
+    perf_fd = -1;
+    return;
+  }
+  ioctl(perf_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void instr_begin(struct instr_mark *m)
+{
+#ifdef INSTRUMENT_PERF
+  perf_read(m->hw);
+#endif
+  m->cycles = instr_cycles();
+}
+
+void instr_end(int slot, struct instr_mark *m)
+{
+  uint64_t c = instr_cycles() - m->cycles;
+  struct instr_slotstat *s = &slots[slot];
+
+  s->calls++;
+  s->cycles += c;
+  if (c > s->maxcycles)
+    s->maxcycles = c;
+#ifdef INSTRUMENT_PERF
+  {
+    uint64_t hw[2];
+    perf_read(hw);
+    s->hw[0] += hw[0] - m->hw[0];
+    s->hw[1] += hw[1] - m->hw[1];
+  }
+#endif
+}
+
+/* called once per dispatched event with the current queue depth */
+void instr_queue(double now, int depth)
+{
+  int b, i;
+
+  qarea += qlastdepth * (now - qlasttime);
+  qlasttime = now;
+  qlastdepth = depth;
+
+  if (depth > qmax)
+    qmax = depth;
+  qsum += depth;
+  for (b = 0; b < QBUCKETS-1 && (1 << b) <= depth; b++)
+    ;
+  qhist[b]++;
+
+  if (qsamples++ % qstride == 0) {
+    if (qseries_n == QSERIES) {
+      /* series is full: keep every other sample and halve the rate */
+      for (i = 0; i < QSERIES/2; i++) {
+        qseries_t[i] = qseries_t[2*i];
+        qseries_d[i] = qseries_d[2*i];
+      }
+      qseries_n = QSERIES/2;
+      qstride *= 2;
+    }
+    qseries_t[qseries_n] = now;
+    qseries_d[qseries_n] = depth;
+    qseries_n++;
+  }
+}
+
+static void report_table(void)
+{
+  int i;
+  const struct instr_slotstat *s;
+
+  printf("\n-----  Instrumentation --------\n");
+  printf("%-18s %10s %14s %12s %12s", "slot", "calls", "total cycles",
+         "avg cycles", "max cycles");
+#ifdef INSTRUMENT_PERF
+  printf(" %14s %12s", "instructions", "cache misses");
+#endif
+  printf("\n");
+  for (i = 0; i < IN_NSLOTS; i++) {
+    s = &slots[i];
+    if (s->calls == 0)
+      continue;
+    printf("%-18s %10llu %14llu %12.1f %12llu", slotnames[i],
+           (unsigned long long)s->calls, (unsigned long long)s->cycles,
+           (double)s->cycles / s->calls, (unsigned long long)s->maxcycles);
+#ifdef INSTRUMENT_PERF
+    printf(" %14llu %12llu", (unsigned long long)s->hw[0],
+           (unsigned long long)s->hw[1]);
+#endif
+    printf("\n");
+  }
+
+  printf("event queue depth: max %d, mean per event %.2f, time-weighted mean %.2f\n",
+         qmax, qsamples ? (double)qsum / qsamples : 0.0,
+         qlasttime > 0 ? qarea / qlasttime : 0.0);
+  printf("event queue depth histogram:");
+  for (i = 0; i < QBUCKETS; i++)
+    if (qhist[i])
+      printf(" [%d..%d]:%llu", i ? 1 << (i-1) : 0, i ? (1 << i) - 1 : 0,
+             (unsigned long long)qhist[i]);
+  printf("\n");
+}
+
+static void report_json(void)
+{
+  int i;
+  const struct instr_slotstat *s;
+
+  printf("{\"slots\":{");
+  for (i = 0; i < IN_NSLOTS; i++) {
+    s = &slots[i];
+    printf("%s\"%s\":{\"calls\":%llu,\"cycles\":%llu,\"max_cycles\":%llu",
+           i ? "," : "", slotnames[i], (unsigned long long)s->calls,
+           (unsigned long long)s->cycles, (unsigned long long)s->maxcycles);
+#ifdef INSTRUMENT_PERF
+    printf(",\"instructions\":%llu,\"cache_misses\":%llu",
+           (unsigned long long)s->hw[0], (unsigned long long)s->hw[1]);
+#endif
+    printf("}");
+  }
+  printf("},\"queue\":{\"max\":%d,\"mean\":%.4f,\"time_mean\":%.4f,\"histogram\":[",
+         qmax, qsamples ? (double)qsum / qsamples : 0.0,
+         qlasttime > 0 ? qarea / qlasttime : 0.0);
+  for (i = 0; i < QBUCKETS; i++)
+    printf("%s%llu", i ? "," : "", (unsigned long long)qhist[i]);
+  printf("],\"series\":[");
+  for (i = 0; i < qseries_n; i++)
+    printf("%s[%.3f,%d]", i ? "," : "", qseries_t[i], qseries_d[i]);
+  printf("]}}\n");
+}
+
+void instr_report(int json)
+{
+  if (json)
+    report_json();
+  else
+    report_table();
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/* ******************************************************************
+   Hot-path instrumentation for the emulator event loop.
+
+   Build with -DINSTRUMENT to record, for every event type and every
+   protocol callback, the call count and the total/max cycles spent in
+   it, together with the depth of the event queue over time.  Add
+   -DINSTRUMENT_PERF (Linux only) to also count retired instructions
+   and cache misses through perf_event_open.  Without INSTRUMENT the
+   INSTR_* macros expand to nothing.
+
+   Cycle counts are inclusive: the time charged to A_output also
+   contains the tolayer3/starttimer calls it makes.
+**********************************************************************/
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* things we time */
+enum instr_slot {
+  IN_EV_TIMER,          /* whole dispatch of a TIMER_INTERRUPT event */
+  IN_EV_FROM_LAYER5,    /* whole dispatch of a FROM_LAYER5 event */
+  IN_EV_FROM_LAYER3,    /* whole dispatch of a FROM_LAYER3 event */
+  IN_A_OUTPUT,
+  IN_A_INPUT,
+  IN_A_TIMER,
+  IN_B_OUTPUT,
+  IN_B_INPUT,
+  IN_B_TIMER,
+  IN_INSERTEVENT,
+  IN_TOLAYER3,
+  IN_TOLAYER5,
+  IN_STARTTIMER,
+  IN_STOPTIMER,
+  IN_FREE,
+  IN_NSLOTS
+};
+
+/* read the cycle counter; falls back to a nanosecond clock off x86 */
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t instr_cycles(void)
+{
+  return __rdtsc();
+}
+#else
+extern uint64_t instr_cycles(void);
+#endif
+
+#ifdef INSTRUMENT
+
+struct instr_mark {
+  uint64_t cycles;
+#ifdef INSTRUMENT_PERF
+  uint64_t hw[2];       /* instructions, cache misses */
+#endif
+};
+
+extern void instr_init(void);
+extern void instr_begin(struct instr_mark *m);
+extern void instr_end(int slot, struct instr_mark *m);
+extern void instr_queue(double now, int depth);
+extern void instr_report(int json);
+
+#define INSTR_INIT()          instr_init()
+#define INSTR_START(m)        struct instr_mark m; instr_begin(&m)
+#define INSTR_STOP(slot, m)   instr_end((slot), &m)
+#define INSTR_QUEUE(t, depth) instr_queue((t), (depth))
+#define INSTR_REPORT(json)    instr_report(json)
+
+#else
+
+#define INSTR_INIT()          do { } while (0)
+#define INSTR_START(m)        do { } while (0)
+#define INSTR_STOP(slot, m)   do { } while (0)
+#define INSTR_QUEUE(t, depth) do { } while (0)
+#define INSTR_REPORT(json)    do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+/* ******************************************************************
+   Machine-readable statistics for the emulator.  See metrics.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+static FILE *out;
+static int sock = -1;
+static int format;
+static int header;          /* CSV header written */
+
+void metrics_open(const char *dest, int fmt)
+{
+  struct sockaddr_un addr;
+
+  format = fmt;
+  header = 0;
+  if (strncmp(dest, "unix:", 5) == 0) {
+    if (strlen(dest + 5) >= sizeof(addr.sun_path)) {
+      printf("metrics socket path too long: %s\n", dest + 5);
+      exit(EXIT_FAILURE);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, dest + 5);
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      printf("unable to connect to metrics socket %s: %s\n", dest + 5, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+  if (strcmp(dest, "-") == 0)
+    out = stdout;
+  else if ((out = fopen(dest, "w")) == NULL) {
+    printf("unable to open metrics file %s\n", dest);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* send one line to the socket, giving up on it if the reader is gone */
+static void sendline(const char *line, int len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = send(sock, line, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      printf("metrics socket closed: %s\n", n < 0 ? strerror(errno) : "end of file");
+      close(sock);
+      sock = -1;
+      return;
+    }
+    line += n;
+    len -= n;
+  }
+}
+
+static void put(const char *line, int len)
+{
+  if (out != NULL) {
+    fputs(line, out);
+    fflush(out);
+  }
+  else if (sock >= 0)
+    sendline(line, len);
+}
+
+void metrics_write(const struct metrics *m)
+{
+  char line[1024];
+  int len;
+
+  if (out == NULL && sock < 0)
+    return;
+  if (format == METRICS_CSV && !header) {
+    len = snprintf(line, sizeof(line), "kind,protocol,run,time,wall,events,offered,window_full,"
+                   "sent,resent,new_acks,acks,lost,corrupted,delivered,goodput,goodput_now,"
+                   "queue,events_per_sec\n");
+    put(line, len);
+    header = 1;
+  }
+  if (format == METRICS_CSV)
+    len = snprintf(line, sizeof(line), "%s,%s,%d,%f,%f,%ld,%d,%d,%d,%d,%d,%d,%d,%d,%d,%f,%f,%d,%.0f\n",
+                   m->kind, m->protocol, m->run, m->time, m->wall, m->events, m->offered,
+                   m->window_full, m->sent, m->resent, m->new_acks, m->acks, m->lost,
+                   m->corrupted, m->delivered, m->goodput, m->goodput_now, m->queue,
+                   m->events_per_sec);
+  else
+    len = snprintf(line, sizeof(line), "{\"kind\":\"%s\",\"protocol\":\"%s\",\"run\":%d,"
+                   "\"time\":%f,\"wall\":%f,\"events\":%ld,\"offered\":%d,\"window_full\":%d,"
+                   "\"sent\":%d,\"resent\":%d,\"new_acks\":%d,\"acks\":%d,\"lost\":%d,"
+                   "\"corrupted\":%d,\"delivered\":%d,\"goodput\":%f,\"goodput_now\":%f,"
+                   "\"queue\":%d,\"events_per_sec\":%.0f}\n",
+                   m->kind, m->protocol, m->run, m->time, m->wall, m->events, m->offered,
+                   m->window_full, m->sent, m->resent, m->new_acks, m->acks, m->lost,
+                   m->corrupted, m->delivered, m->goodput, m->goodput_now, m->queue,
+                   m->events_per_sec);
+  put(line, len);
+}
+
+void metrics_close(void)
+{
+  if (out != NULL && out != stdout)
+    fclose(out);
+  out = NULL;
+  if (sock >= 0)
+    close(sock);
+  sock = -1;
+}
+
+double metrics_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,54 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/* ******************************************************************
+   Machine-readable statistics.
+
+   With --metrics the emulator writes a snapshot of its counters every
+   --metrics-every simulated time units and/or every --metrics-events
+   events while it runs, and one final record per protocol run with the
+   same fields.  Records are JSON objects, one per line, or CSV rows
+   under a header line.  They go to a file ("-" for standard output) or,
+   with unix:PATH, to a Unix stream socket that something is listening
+   on; if the listener goes away the run carries on without it.
+**********************************************************************/
+
+#define METRICS_JSON 0
+#define METRICS_CSV  1
+
+struct metrics {
+  const char *kind;         /* "snapshot" or "final" */
+  const char *protocol;
+  int run;                  /* which of the --protocol runs */
+  double time;              /* simulated time */
+  double wall;              /* wall-clock seconds since the run started */
+  long events;              /* events handled so far */
+  int offered;              /* messages from layer 5 */
+  int window_full;
+  int sent;                 /* packets A gave to layer 3 */
+  int resent;
+  int new_acks;
+  int acks;                 /* total_ACKs_received */
+  int lost;
+  int corrupted;
+  int delivered;            /* messages delivered to layer 5 */
+  double goodput;           /* delivered per time unit over the whole run */
+  double goodput_now;       /* and since the previous record */
+  int queue;                /* events on the event list */
+  double events_per_sec;    /* events per wall-clock second since the previous
+                               record; over the whole run in a final one */
+};
+
+/* open DEST (a file name, "-" or unix:PATH) for records in FORMAT;
+   exits on failure */
+extern void metrics_open(const char *dest, int format);
+
+/* write one record */
+extern void metrics_write(const struct metrics *m);
+
+extern void metrics_close(void);
+
+/* wall-clock seconds from an arbitrary start */
+extern double metrics_clock(void);
+
+#endif
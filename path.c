@@ -0,0 +1,116 @@
+/* ******************************************************************
+   Parallel paths and packet schedulers for the emulator's medium.
+   See path.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "path.h"
+
+static const char *schednames[] = { "rr", "minrtt", "weighted", "redundant" };
+
+int path_parse(struct path *p, const char *spec)
+{
+  const char *slash = strchr(spec, '/');
+  int n;
+
+  memset(p, 0, sizeof(*p));
+  n = sscanf(spec, "%lf,%lf,%lf", &p->delay, &p->jitter, &p->rate);
+  if (n < 2 || p->delay < 0.0 || p->jitter < 0.0 || p->rate < 0.0)
+    return -1;
+  if (slash != NULL) {
+    if (channel_parse(&p->ch, slash + 1) != 0)
+      return -1;
+    p->channelset = 1;
+  }
+  return 0;
+}
+
+int sched_parse(const char *name)
+{
+  int s;
+
+  for (s = SCHED_RR; s <= SCHED_REDUNDANT; s++)
+    if (strcmp(name, schednames[s]) == 0)
+      return s;
+  return -1;
+}
+
+const char *sched_name(int sched)
+{
+  return schednames[sched];
+}
+
+void path_start(struct path *p)
+{
+  p->busy = p->last = 0.0;
+  p->credit = 0.0;
+  p->sent = p->arrived = p->used = p->delivered = 0;
+  p->queueing = 0.0;
+}
+
+/* when a packet offered at now would start out on p */
+static double startat(const struct path *p, double now)
+{
+  return p->busy > now ? p->busy : now;
+}
+
+int path_pick(struct path *paths, int npaths, int sched, double now)
+{
+  double t, w, best = 0.0, total = 0.0;
+  int i, pick = 0;
+
+  if (sched == SCHED_MINRTT) {
+    for (i = 0; i < npaths; i++) {
+      t = startat(&paths[i], now) + (paths[i].rate > 0.0 ? 1.0 / paths[i].rate : 0.0) +
+        paths[i].delay + paths[i].jitter / 2;
+      if (i == 0 || t < best) {
+        best = t;
+        pick = i;
+      }
+    }
+    return pick;
+  }
+
+  /* smooth weighted round robin; with equal weights, plain round robin */
+  for (i = 0; i < npaths; i++) {
+    w = sched == SCHED_WEIGHTED ? paths[i].rate : 1.0;
+    paths[i].credit += w;
+    total += w;
+    if (paths[i].credit > paths[pick].credit)
+      pick = i;
+  }
+  paths[pick].credit -= total;
+  return pick;
+}
+
+double path_send(struct path *p, double now)
+{
+  double start = startat(p, now), t;
+
+  p->queueing += start - now;
+  p->busy = start + (p->rate > 0.0 ? 1.0 / p->rate : 0.0);
+  t = p->busy + p->delay + p->jitter * jimsrand();
+  if (t < p->last)      /* a path does not reorder */
+    t = p->last;
+  p->last = t;
+  return t;
+}
+
+void path_report(struct path *p, int i, int AorB, double now)
+{
+  printf("path %d %s (delay %g, jitter %g, rate ", i + 1, AorB == A ? "A->B" : "B->A",
+         p->delay, p->jitter);
+  if (p->rate > 0.0)
+    printf("%g): ", p->rate);
+  else
+    printf("unlimited): ");
+  printf("%d packets, %d arrived, %d used, mean queueing %f\n", p->sent, p->arrived, p->used,
+         p->sent ? p->queueing / p->sent : 0.0);
+  if (AorB == A)
+    printf("    messages delivered on its packets: %d, goodput %f\n", p->delivered,
+           now > 0 ? p->delivered / now : 0.0);
+  printf("    ");
+  channel_report(&p->ch, AorB);
+}
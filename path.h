@@ -0,0 +1,79 @@
+#ifndef PATH_H
+#define PATH_H
+
+/* ******************************************************************
+   Parallel paths through the emulator's medium.
+
+   With one or more --path options every packet given to layer 3 goes
+   over one of several paths instead of the single channel.  A path has
+   its own propagation delay, jitter, transmission rate and loss and
+   corruption model, and delivers in order; packets on different paths
+   overtake each other.  A scheduler picks the path for each packet:
+
+     rr          round robin
+     minrtt      the path the packet would arrive over first, counting
+                 the packets already queued on it
+     weighted    smooth weighted round robin, weighted by rate
+     redundant   a copy on every path; the first to arrive is used
+
+   The receiving side of the emulator puts packets back in the order
+   they were sent before handing them to layer 4 (see emulator.c).
+
+   Spec (--path=SPEC): DELAY,JITTER[,RATE][/CHANNEL]
+     DELAY      fixed one way delay
+     JITTER     plus a uniform random delay on [0, JITTER]
+     RATE       packets per time unit the path transmits, 0 (default)
+                for no limit; packets wait for the path to be free
+     CHANNEL    a channel.h model for the path; without one the path
+                loses and corrupts like the single channel would
+**********************************************************************/
+
+#include "channel.h"
+
+#define MAXPATHS 8
+
+#define SCHED_RR        0
+#define SCHED_MINRTT    1
+#define SCHED_WEIGHTED  2
+#define SCHED_REDUNDANT 3
+
+struct path {
+  double delay;
+  double jitter;
+  double rate;          /* packets per time unit, 0 for no limit */
+  int channelset;       /* ch came from the spec */
+  struct channel ch;
+
+  double busy;          /* when the path has sent what is queued on it */
+  double last;          /* latest arrival time of a packet on the path */
+  double credit;        /* weighted round robin */
+
+  /* statistics */
+  int sent;             /* packets offered to the path */
+  int arrived;          /* packets that came out of it */
+  int used;             /* and were handed to layer 4 (not duplicates) */
+  int delivered;        /* messages delivered to layer 5 on its packets */
+  double queueing;      /* total time packets waited for the path */
+};
+
+/* parse a path SPEC into p; returns 0 on success */
+extern int path_parse(struct path *p, const char *spec);
+
+/* the SCHED_* code of a scheduler name, or -1 */
+extern int sched_parse(const char *name);
+extern const char *sched_name(int sched);
+
+/* reset p's queue, scheduler state and statistics (not its channel) */
+extern void path_start(struct path *p);
+
+/* the path a packet offered at now goes over, for every scheduler but
+   SCHED_REDUNDANT */
+extern int path_pick(struct path *paths, int npaths, int sched, double now);
+
+/* a packet that was not lost enters p at now: returns when it comes out */
+extern double path_send(struct path *p, double now);
+
+/* print p's statistics; path i in the direction AorB sends in */
+extern void path_report(struct path *p, int i, int AorB, double now);
+
+#endif
@@ -0,0 +1,53 @@
+/* ******************************************************************
+   Registry of the protocols the emulator can run.  To add one, give it
+   a const struct protocol and list it here.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "protocol.h"
+#include "gbn.h"
+#include "sr.h"
+
+const struct protocol *const protocols[] = {
+  &gbn_protocol,
+  &gbn_sack_protocol,
+  &gbn_nack_protocol,
+  &gbn_fec_protocol,
+  &sr_protocol,
+  NULL
+};
+
+const struct protocol *findprotocol(const char *name)
+{
+  int i;
+
+  for (i = 0; protocols[i] != NULL; i++)
+    if (strcmp(protocols[i]->name, name) == 0)
+      return protocols[i];
+  return NULL;
+}
+
+int protocol_check(const struct protocol *p, const struct protoconf *conf)
+{
+  const char *opt = NULL;
+
+  if (conf->sack && !(p->options & PROTO_SACK))
+    opt = "--sack";
+  else if (conf->nack && !(p->options & PROTO_NACK))
+    opt = "--nack";
+  else if (conf->fec_k > 0 && !(p->options & PROTO_FEC))
+    opt = "--fec";
+  else if ((conf->backlog_capacity > 0 || conf->backlog_block) && !(p->options & PROTO_BACKLOG))
+    opt = "--backlog";
+  if (opt != NULL) {
+    printf("protocol %s does not support %s\n", p->name, opt);
+    return -1;
+  }
+  if (conf->fec_k > p->fec_maxk) {
+    printf("protocol %s takes FEC groups of at most %d packets\n", p->name, p->fec_maxk);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+/* ******************************************************************
+   Transport protocols the emulator can run.
+
+   A protocol is a table of the layer 4 entry points.  Each run creates
+   one instance holding all of the protocol's state and passes it to
+   every call, so several protocols can live in one binary and the
+   same scenario can be run under each in turn.  Protocols are looked
+   up by name in the protocols[] registry (protocol.c).
+
+   Include emulator.h first.
+**********************************************************************/
+
+/* included for extension to bidirectional communication */
+#define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
+
+/* options given on the command line; a protocol uses the ones it lists
+   in its options mask, and the front ends refuse the others */
+struct protoconf {
+  int sack;                 /* selective acknowledgements (gbn) */
+  int nack;                 /* negative acknowledgements (gbn) */
+  int fec_k;                /* FEC group size, 0 for none (gbn) */
+  int fec_m;                /* parity packets per group (gbn) */
+  int backlog_capacity;     /* messages queued at A while the window is full (gbn, sr) */
+  int backlog_block;        /* stop layer 5 instead of dropping when full (gbn, sr) */
+};
+
+/* bits of struct protocol's options */
+#define PROTO_SACK     0x1
+#define PROTO_NACK     0x2
+#define PROTO_FEC      0x4
+#define PROTO_BACKLOG  0x8
+
+struct protocol {
+  const char *name;
+  const char *description;
+  void *(*create)(const struct protoconf *conf);
+  void (*destroy)(void *self);
+
+  void (*A_init)(void *self);
+  void (*A_output)(void *self, struct msg message);
+  void (*A_input)(void *self, struct pkt packet);
+  void (*A_timerinterrupt)(void *self);
+
+  void (*B_init)(void *self);
+  void (*B_output)(void *self, struct msg message);  /* only if BIDIRECTIONAL */
+  void (*B_input)(void *self, struct pkt packet);
+  void (*B_timerinterrupt)(void *self);
+
+  unsigned options;         /* PROTO_* of the protoconf fields it honours */
+  int fec_maxk;             /* largest FEC group it takes, with PROTO_FEC */
+};
+
+/* all registered protocols, NULL terminated */
+extern const struct protocol *const protocols[];
+
+/* the protocol called name, or NULL */
+extern const struct protocol *findprotocol(const char *name);
+
+/* 0 if p honours every option set in conf; otherwise says which one it
+   does not and returns -1 */
+extern int protocol_check(const struct protocol *p, const struct protoconf *conf);
+
+#endif
@@ -0,0 +1,233 @@
+/* ******************************************************************
+   Parallel replications with sequential stopping.  See replicate.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "replicate.h"
+
+static const char *metricnames[REP_NMETRICS] = {
+  "goodput", "resend ratio", "delivery latency"
+};
+
+/* running mean and variance (Welford) */
+struct runstat {
+  int n;
+  double mean;
+  double m2;
+  int needed;           /* replications when the precision was first met */
+};
+
+static void runstat_add(struct runstat *s, double x)
+{
+  double d = x - s->mean;
+
+  s->n++;
+  s->mean += d / s->n;
+  s->m2 += d * (x - s->mean);
+}
+
+/* regularized incomplete beta function I_x(a, b), by its continued
+   fraction (modified Lentz), Numerical Recipes 6.4 */
+static double betainc(double x, double a, double b)
+{
+  double front, c, d, f, num;
+  int i, m;
+
+  if (x <= 0.0)
+    return 0.0;
+  if (x >= 1.0)
+    return 1.0;
+  if (x > (a + 1) / (a + b + 2))        /* the fraction converges slowly here */
+    return 1.0 - betainc(1.0 - x, b, a);
+  front = exp(a*log(x) + b*log(1.0 - x) - log(a) -
+              (lgamma(a) + lgamma(b) - lgamma(a + b)));
+  f = c = 1.0;
+  d = 0.0;
+  for (i = 0; i <= 400; i++) {
+    m = i / 2;
+    if (i == 0)
+      num = 1.0;
+    else if (i % 2 == 0)
+      num = m*(b - m)*x / ((a + 2*m - 1)*(a + 2*m));
+    else
+      num = -(a + m)*(a + b + m)*x / ((a + 2*m)*(a + 2*m + 1));
+    d = 1.0 + num*d;
+    if (fabs(d) < 1e-300)
+      d = 1e-300;
+    d = 1.0 / d;
+    c = 1.0 + num/c;
+    if (fabs(c) < 1e-300)
+      c = 1e-300;
+    f *= c*d;
+    if (fabs(1.0 - c*d) < 1e-12)
+      break;
+  }
+  return front * (f - 1.0);
+}
+
+/* P(T > t) for Student's t with df degrees of freedom, t >= 0 */
+static double ttail(double t, int df)
+{
+  return 0.5 * betainc(df / (df + t*t), df / 2.0, 0.5);
+}
+
+/* upper p quantile of Student's t with df degrees of freedom, by
+   bisection on the exact tail; series approximations are far out at
+   the small df the first few replications give */
+static double tquantile(double p, int df)
+{
+  double lo = 0.0, hi = 1.0, mid;
+  int i;
+
+  while (ttail(hi, df) > p)
+    hi *= 2;
+  for (i = 0; i < 100 && hi - lo > 1e-9 * hi; i++) {
+    mid = (lo + hi) / 2;
+    if (ttail(mid, df) > p)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return (lo + hi) / 2;
+}
+
+static double halfwidth(const struct runstat *s, double confidence)
+{
+  if (s->n < 2)
+    return 0.0;
+  return tquantile((1.0 - confidence) / 2, s->n - 1) * sqrt(s->m2 / (s->n - 1) / s->n);
+}
+
+static int precise(const struct runstat *s, const struct repconf *c)
+{
+  return halfwidth(s, c->confidence) <= c->precision * fabs(s->mean);
+}
+
+/* start replication k in a child; its result comes back through *fd */
+static pid_t startrun(const struct repconf *c, rep_run run, int k, int *fd)
+{
+  double v[REP_NMETRICS];
+  int p[2];
+  pid_t pid;
+
+  if (pipe(p) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  fflush(stdout);       /* or the child would print it again */
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    close(p[0]);
+    run(c->seed + k, v);
+    if (write(p[1], v, sizeof(v)) != sizeof(v))
+      _exit(EXIT_FAILURE);
+    _exit(EXIT_SUCCESS);
+  }
+  close(p[1]);
+  *fd = p[0];
+  return pid;
+}
+
+void replicate(const struct repconf *c, rep_run run)
+{
+  int jobs = c->jobs > 0 ? c->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  double (*results)[REP_NMETRICS];
+  char *done;
+  pid_t *pids, pid;
+  int *fds, *index;
+  struct runstat stats[REP_NMETRICS] = {{0}};
+  int next = 0, taken = 0, running = 0, stop = 0;
+  int status, i, m, met;
+
+  if (jobs < 1)
+    jobs = 1;
+  results = malloc(c->maxreps * sizeof(*results));
+  done = calloc(c->maxreps, 1);
+  pids = calloc(jobs, sizeof(pid_t));
+  fds = malloc(jobs * sizeof(int));
+  index = malloc(jobs * sizeof(int));
+  if (results == NULL || done == NULL || pids == NULL || fds == NULL || index == NULL) {
+    printf("memory allocation for replications failed.");
+    exit(EXIT_FAILURE);
+  }
+
+  while (1) {
+    /* keep every job busy */
+    for (i = 0; i < jobs && !stop && next < c->maxreps; i++)
+      if (pids[i] == 0) {
+        index[i] = next;
+        pids[i] = startrun(c, run, next++, &fds[i]);
+        running++;
+      }
+    if (running == 0)
+      break;
+
+    pid = wait(&status);
+    for (i = 0; i < jobs && pids[i] != pid; i++)
+      ;
+    if (i == jobs)
+      continue;
+    pids[i] = 0;
+    running--;
+    if (!stop) {
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS ||
+          read(fds[i], results[index[i]], sizeof(results[0])) != sizeof(results[0])) {
+        printf("replication %d failed\n", index[i]);
+        exit(EXIT_FAILURE);
+      }
+      done[index[i]] = 1;
+    }
+    close(fds[i]);
+
+    /* take results in seed order, so the job count cannot change them */
+    while (!stop && taken < next && done[taken]) {
+      met = 0;
+      for (m = 0; m < REP_NMETRICS; m++) {
+        runstat_add(&stats[m], results[taken][m]);
+        if (stats[m].n >= c->minreps && stats[m].n >= 2 && precise(&stats[m], c)) {
+          met++;
+          if (stats[m].needed == 0)
+            stats[m].needed = stats[m].n;
+        }
+      }
+      taken++;
+      if (met == REP_NMETRICS || taken == c->maxreps) {
+        stop = 1;
+        for (i = 0; i < jobs; i++)    /* runs nobody is waiting for */
+          if (pids[i] != 0)
+            kill(pids[i], SIGTERM);
+      }
+    }
+  }
+
+  printf("\n-----  Replications --------\n");
+  printf("%d replications (seeds %u to %u), %d jobs, %.0f%% confidence intervals\n",
+         taken, c->seed, c->seed + taken - 1, jobs, 100.0 * c->confidence);
+  printf("%-18s %14s %14s %10s  %s\n", "metric", "mean", "half width", "relative",
+         "replications needed");
+  for (m = 0; m < REP_NMETRICS; m++) {
+    double hw = halfwidth(&stats[m], c->confidence);
+
+    printf("%-18s %14.6f %14.6f %9.2f%%  ", metricnames[m], stats[m].mean, hw,
+           stats[m].mean != 0.0 ? 100.0 * hw / fabs(stats[m].mean) : 0.0);
+    if (stats[m].needed)
+      printf("%d\n", stats[m].needed);
+    else
+      printf("not reached (precision %.2f%%)\n", 100.0 * c->precision);
+  }
+
+  free(results);
+  free(done);
+  free(pids);
+  free(fds);
+  free(index);
+}
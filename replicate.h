@@ -0,0 +1,42 @@
+#ifndef REPLICATE_H
+#define REPLICATE_H
+
+/* ******************************************************************
+   Independent replications of a scenario with sequential stopping.
+
+   Replication k runs the scenario with random seed seed+k, so
+   replication 0 is the same as a plain run.  Runs are forked in
+   parallel, one per job, but their results are taken in seed order;
+   the answer does not depend on the number of jobs.  After each result
+   the running mean and confidence interval of every metric are
+   updated, and no more runs are started once every interval's half
+   width is within the requested fraction of its mean (or maxreps
+   have been done).
+**********************************************************************/
+
+/* what each replication measures, after the warm-up period */
+enum rep_metric {
+  REP_GOODPUT,          /* messages delivered per time unit */
+  REP_RESENDS,          /* resent packets / packets sent by A */
+  REP_LATENCY,          /* mean time from layer 5 at A to layer 5 at B */
+  REP_NMETRICS
+};
+
+struct repconf {
+  double precision;     /* relative half width to stop at, e.g. 0.05 */
+  double confidence;    /* confidence level of the intervals, e.g. 0.95 */
+  int minreps;          /* replications before the stopping test applies */
+  int maxreps;          /* give up after this many */
+  int jobs;             /* replications run at once; 0 = one per core */
+  unsigned seed;        /* seed of replication 0 */
+};
+
+/* runs one replication with the given seed, filling v[REP_NMETRICS].
+   Called in a child process. */
+typedef void (*rep_run)(unsigned seed, double *v);
+
+/* replicate under c and print the intervals and the number of
+   replications each metric needed */
+extern void replicate(const struct repconf *c, rep_run run);
+
+#endif
@@ -0,0 +1,519 @@
+/* ******************************************************************
+   Shared-memory runtime for the transport protocols.
+
+   Runs A and B as two threads (or, with --fork, two processes) on one
+   host, connected by a pair of lock-free single-producer/single-
+   consumer rings in shared memory, one per direction.  This is the
+   fastest local path for the tolayer3 contract: no system calls and no
+   event queue on the packet path.
+   - tolayer3 copies the packet into the next free ring slot and
+     publishes it with a release store of the head index; the other
+     side passes a copy of the slot to its input routine (the protocol
+     interface takes packets by value) and then releases it by
+     advancing the tail
+   - the emulator's loss and corruption models are an optional stage
+     in front of each ring
+   - timers are deadlines checked by each side's polling loop against
+     the (vDSO) monotonic clock; one protocol time unit is --unit
+     microseconds
+   - layer 5 at A offers a message every --interval nanoseconds, or on
+     every loop iteration by default.  A message the protocol refuses
+     (window full) is offered again once a packet or timeout has been
+     handled, so the sender is held back by the window; with --flood it
+     is dropped and the next one offered, as fast as the loop goes
+   - both sides spin; on a single core an idle side yields instead
+
+   At the end it reports packets and messages per second, message
+   latency from A_output to B's tolayer5 and the CPU time per packet.
+
+   Linux only.  Build with
+     gcc -O2 -pthread -o shm shm.c gbn.c sr.c protocol.c stats.c channel.c fec.c backlog.c checksum.c instrument.c -lm
+**********************************************************************/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "emulator.h"
+#include "protocol.h"
+#include "channel.h"
+#include "checksum.h"
+
+#define RINGSIZE 1024           /* packets per ring, a power of two */
+#define CACHELINE 64
+
+/* the protocol statistics (stats.c) are updated by each side in its own
+   thread or process: A's by A, B's by B */
+
+/* one direction.  Each index is written by one side only and lives on
+   its own cache line, next to that side's cached copy of the other */
+struct ring {
+  _Alignas(CACHELINE) _Atomic uint64_t head;  /* next slot to fill */
+  uint64_t tailcache;                         /* producer's view of tail */
+  _Alignas(CACHELINE) _Atomic uint64_t tail;  /* next slot to read */
+  uint64_t headcache;                         /* consumer's view of head */
+  _Alignas(CACHELINE) struct pkt slots[RINGSIZE];
+};
+
+/* everything both sides touch, in memory shared across a fork */
+struct shared {
+  struct ring ring[2];          /* indexed by the sending entity */
+  struct channel channels[2];   /* used only by the sending entity */
+  long overflow[2];             /* packets dropped on a full ring */
+  _Alignas(CACHELINE) _Atomic int done;
+  _Alignas(CACHELINE) _Atomic long delivered;
+  long packets_received;        /* B's counters, copied out at the end */
+  double latencysum, latencymax;
+  uint64_t accepted[];          /* when message k was accepted at A */
+};
+
+static struct shared *sh;
+
+static const struct protocol *proto;
+static void *instance;
+static struct protoconf conf;
+
+static long unit_us = 1000;
+static long interval_ns;
+static int nsimmax = 1000000;
+static unsigned seed = 9999;
+static int useshim, usefork;
+static int flood;                   /* --flood: drop refused messages */
+static int oneshared;               /* A and B share the only core */
+
+static uint64_t start_ns;
+static __thread uint64_t deadline;  /* this side's timer, 0 when off */
+static __thread unsigned randstate;
+static int nsim;                    /* A: messages offered */
+static long naccepted;              /* A: and taken by the protocol */
+static int paused;                  /* A: layer 5 stopped */
+static int refused;                 /* A: last message refused, wait */
+static long offset_delivered;       /* B: index of the next message */
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* per-thread generator, so the two sides never share random state */
+double jimsrand(void)
+{
+  return rand_r(&randstate) / (double)RAND_MAX;
+}
+
+double gettime(void)
+{
+  return (now_ns() - start_ns) / (1000.0 * unit_us);
+}
+
+/********************** protocol-callable routines ***********************/
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  struct ring *r = &sh->ring[AorB];
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  struct pkt *slot;
+  double x;
+
+  if (useshim) {
+    if (channel_lose(&sh->channels[AorB]))
+      return;
+    if (channel_corrupt(&sh->channels[AorB])) {
+      if ((x = jimsrand()) < .75)
+        packet.payload[0] = 'Z';
+      else if (x < .875)
+        packet.seqnum = 999999;
+      else
+        packet.acknum = 999999;
+    }
+  }
+
+  if (head - r->tailcache == RINGSIZE) {
+    r->tailcache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head - r->tailcache == RINGSIZE) {
+      sh->overflow[AorB]++;
+      return;
+    }
+  }
+  slot = &r->slots[head & (RINGSIZE - 1)];
+  *slot = packet;
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  double lat;
+
+  if (TRACING(3))
+    printf("          TOLAYER5: data received by application at %c: %.20s\n",
+           AorB == A ? 'A' : 'B', datasent);
+  /* messages arrive in order, so this is message offset_delivered */
+  lat = (now_ns() - sh->accepted[offset_delivered++]) / 1000.0;
+  sh->latencysum += lat;
+  if (lat > sh->latencymax)
+    sh->latencymax = lat;
+  atomic_store_explicit(&sh->delivered, offset_delivered, memory_order_release);
+}
+
+void starttimer(int AorB, double increment)
+{
+  (void)AorB;           /* each side's thread has its own deadline */
+  if (deadline != 0) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  deadline = now_ns() + (uint64_t)(increment * unit_us * 1000.0);
+}
+
+void stoptimer(int AorB)
+{
+  (void)AorB;
+  if (deadline == 0) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  deadline = 0;
+}
+
+void stoplayer5(int AorB)
+{
+  (void)AorB;           /* only A has a layer 5 */
+  paused = 1;
+}
+
+void startlayer5(int AorB)
+{
+  (void)AorB;
+  paused = 0;
+}
+
+/************************** the two sides ****************************/
+
+/* hand every packet waiting for me to my input routine; each is copied
+   out of its slot in the call, then the slot is released */
+static int drain(int me)
+{
+  struct ring *r = &sh->ring[(me+1) % 2];
+  uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  int n = 0;
+
+  if (tail == r->headcache) {
+    r->headcache = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail == r->headcache)
+      return 0;
+  }
+  while (tail != r->headcache) {
+    if (me == A)
+      proto->A_input(instance, r->slots[tail & (RINGSIZE - 1)]);
+    else
+      proto->B_input(instance, r->slots[tail & (RINGSIZE - 1)]);
+    atomic_store_explicit(&r->tail, ++tail, memory_order_release);
+    n++;
+  }
+  return n;
+}
+
+static void offer(void)
+{
+  struct msg m;
+  int dropped = window_full;
+
+  memset(m.data, 'a' + nsim % 26, 20);
+  /* stamp the slot first: B may deliver it before A_output returns */
+  sh->accepted[naccepted] = now_ns();
+  proto->A_output(instance, m);
+  if (window_full == dropped)
+    naccepted++;
+  else if (!flood) {
+    refused = 1;          /* offer it again when the window may have moved */
+    return;
+  }
+  nsim++;
+}
+
+static void runside(int me)
+{
+  uint64_t now, nextoffer = 0, lastprogress = now_ns();
+  long seen = 0, d;
+  int busy;
+
+  randstate = seed + me;
+  while (!atomic_load_explicit(&sh->done, memory_order_relaxed)) {
+    busy = drain(me);
+    now = now_ns();
+    if (deadline != 0 && now >= deadline) {
+      deadline = 0;
+      busy = 1;
+      if (me == A)
+        proto->A_timerinterrupt(instance);
+      else
+        proto->B_timerinterrupt(instance);
+    }
+    if (me == A && busy)
+      refused = 0;
+    if (me == A && nsim < nsimmax && !paused && !refused && now >= nextoffer) {
+      offer();
+      nextoffer = now + interval_ns;
+      busy = 1;
+    }
+    /* with one core the other side only runs when we let it */
+    if (!busy && oneshared)
+      sched_yield();
+    if (me != A)
+      continue;
+
+    /* A decides when the run is over */
+    d = atomic_load_explicit(&sh->delivered, memory_order_acquire);
+    if (d != seen) {
+      seen = d;
+      lastprogress = now;
+    }
+    if (nsim == nsimmax && d == naccepted)
+      atomic_store(&sh->done, 1);
+    else if (now - lastprogress > 2000000000u) {
+      printf("no progress for 2 s, giving up with %ld messages undelivered\n", naccepted - d);
+      atomic_store(&sh->done, 1);
+    }
+  }
+  if (me == B)
+    sh->packets_received = packets_received;
+}
+
+static void *bthread(void *arg)
+{
+  (void)arg;
+  runside(B);
+  return NULL;
+}
+
+/************************** set up and report ************************/
+
+static void usage(const char *prog)
+{
+  int i;
+
+  printf("usage: %s [options]\n", prog);
+  printf("  --protocol=NAME          transport protocol (default gbn):\n");
+  for (i = 0; protocols[i] != NULL; i++)
+    printf("                             %-10s %s\n", protocols[i]->name, protocols[i]->description);
+  printf("  --messages=N             messages to send (default 1000000)\n");
+  printf("  --interval=NSEC          time between messages from layer 5 (default 0:\n");
+  printf("                           one per loop iteration)\n");
+  printf("  --unit=USEC              length of one protocol time unit (default 1000)\n");
+  printf("  --channel=SPEC           loss/corruption stage on both rings\n");
+  printf("  --channel-ab=SPEC        stage on the A->B ring only\n");
+  printf("  --channel-ba=SPEC        stage on the B->A ring only\n");
+  printf("                           (see the emulator; default none)\n");
+  printf("  --sack                   selective acknowledgements (gbn only)\n");
+  printf("  --checksum=NAME          packet checksum: sum (default), crc32c or inet\n");
+  printf("  --backlog=N[,tail|block] queue up to N messages at A while the window is full\n");
+  printf("  --flood                  drop a message the window refuses and offer the\n");
+  printf("                           next at once, instead of offering it again\n");
+  printf("                           once the window may have moved\n");
+  printf("  --fork                   run B in a separate process, not a thread\n");
+  printf("  --seed=N                 random seed for the loss stage (default 9999)\n");
+  printf("  --trace=N                protocol trace level (default 0)\n");
+  printf("  --help                   show this message\n");
+}
+
+static void parseargs(int argc, char **argv, struct channel *channels)
+{
+  static const struct option longopts[] = {
+    { "protocol",   required_argument, NULL, 'p' },
+    { "messages",   required_argument, NULL, 'n' },
+    { "interval",   required_argument, NULL, 'i' },
+    { "unit",       required_argument, NULL, 'u' },
+    { "channel",    required_argument, NULL, 'c' },
+    { "channel-ab", required_argument, NULL, '0' },
+    { "channel-ba", required_argument, NULL, '1' },
+    { "sack",       no_argument,       NULL, 's' },
+    { "checksum",   required_argument, NULL, 'k' },
+    { "backlog",    required_argument, NULL, 'b' },
+    { "fork",       no_argument,       NULL, 'f' },
+    { "flood",      no_argument,       NULL, 'F' },
+    { "seed",       required_argument, NULL, 'S' },
+    { "trace",      required_argument, NULL, 't' },
+    { "help",       no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  char policy[8];
+  int c, i;
+
+  proto = findprotocol("gbn");
+  for (i = A; i <= B; i++)
+    channel_bernoulli(&channels[i], 0.0, 0.0);
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+    case 'p':
+      if ((proto = findprotocol(optarg)) == NULL) {
+        printf("unknown protocol: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'n':
+      if (sscanf(optarg, "%d", &nsimmax) != 1 || nsimmax < 1) {
+        printf("bad message count: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'i':
+      if (sscanf(optarg, "%ld", &interval_ns) != 1 || interval_ns < 0) {
+        printf("bad interval: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'u':
+      if (sscanf(optarg, "%ld", &unit_us) != 1 || unit_us < 1) {
+        printf("bad time unit: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'c':
+    case '0':
+    case '1':
+      for (i = A; i <= B; i++)
+        if ((c == 'c' || c == '0' + i) && channel_parse(&channels[i], optarg) != 0) {
+          printf("bad channel model: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      useshim = 1;
+      break;
+    case 's':
+      conf.sack = 1;
+      break;
+    case 'b':
+      strcpy(policy, "tail");
+      if (sscanf(optarg, "%d,%7s", &conf.backlog_capacity, policy) < 1 || conf.backlog_capacity < 0 ||
+          (strcmp(policy, "tail") != 0 && strcmp(policy, "block") != 0)) {
+        printf("bad backlog: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      conf.backlog_block = strcmp(policy, "block") == 0;
+      break;
+    case 'f':
+      usefork = 1;
+      break;
+    case 'F':
+      flood = 1;
+      break;
+    case 'k':
+      if ((checksum_kind = checksum_parse(optarg)) < 0) {
+        printf("unknown checksum: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'S':
+      if (sscanf(optarg, "%u", &seed) != 1) {
+        printf("bad seed: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 't':
+      TRACE = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static double cpuseconds(int who)
+{
+  struct rusage ru;
+
+  getrusage(who, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+  struct channel channels[2];
+  pthread_t tid;
+  pid_t pid = 0;
+  size_t size;
+  long delivered, packets;
+  double elapsed, cpu;
+  int i;
+
+  parseargs(argc, argv, channels);
+  if (protocol_check(proto, &conf) != 0)
+    exit(EXIT_FAILURE);
+  size = sizeof(struct shared) + nsimmax * sizeof(uint64_t);
+  sh = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (sh == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  for (i = A; i <= B; i++) {
+    sh->channels[i] = channels[i];
+    channel_start(&sh->channels[i]);
+  }
+
+  oneshared = sysconf(_SC_NPROCESSORS_ONLN) < 2;
+
+  instance = proto->create(&conf);
+  start_ns = now_ns();
+  proto->A_init(instance);
+  proto->B_init(instance);
+
+  fflush(stdout);
+  if (usefork) {
+    pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+      runside(B);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  else if (pthread_create(&tid, NULL, bthread, NULL) != 0) {
+    printf("unable to start B\n");
+    exit(EXIT_FAILURE);
+  }
+  runside(A);
+  if (usefork)
+    waitpid(pid, NULL, 0);
+  else
+    pthread_join(tid, NULL);
+  elapsed = (now_ns() - start_ns) / 1e9;
+  cpu = cpuseconds(RUSAGE_SELF) + (usefork ? cpuseconds(RUSAGE_CHILDREN) : 0.0);
+
+  delivered = atomic_load(&sh->delivered);
+  packets = atomic_load(&sh->ring[A].head) + atomic_load(&sh->ring[B].head);
+  printf("shared memory (%s), %s: %d messages offered, %d refused (window full), %ld delivered in %.3f s\n",
+         usefork ? "processes" : "threads", proto->name, nsim, window_full, delivered, elapsed);
+  printf("number of packet resends by A:  %d, timeout recoveries:  %d, correct packets received at B:  %ld\n",
+         packets_resent, recoveries, sh->packets_received);
+  for (i = A; i <= B; i++) {
+    printf("%s: %lu packets through the ring, %ld dropped on a full ring\n",
+           i == A ? "A->B" : "B->A", (unsigned long)atomic_load(&sh->ring[i].head), sh->overflow[i]);
+    if (useshim)
+      channel_report(&sh->channels[i], i);
+  }
+  printf("throughput: %.0f packets/s, %.0f messages/s\n", packets / elapsed, delivered / elapsed);
+  printf("message latency: mean %.3f us, max %.3f us\n",
+         delivered ? sh->latencysum / delivered : 0.0, sh->latencymax);
+  printf("cpu: %.3f s, %.1f ns per packet (both sides spin, so this is about 2x wall time)\n",
+         cpu, packets ? 1e9 * cpu / packets : 0.0);
+  proto->destroy(instance);
+  return EXIT_SUCCESS;
+}
@@ -2,10 +2,13 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "emulator.h"
-#include "gbn.h"
+#include "protocol.h"
+#include "checksum.h"
+#include "sr.h"
+#include "backlog.h"
 
 /* ******************************************************************
-   Go Back N protocol.  Adapted from J.F.Kurose
+   Selective Repeat protocol.  Adapted from J.F.Kurose
    ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2
 
    Network properties:
@@ -19,36 +22,55 @@
    Modifications:
    - removed bidirectional GBN code and other code not used by prac.
    - fixed C style to adhere to current programming style
-   - added GBN implementation
+   - added SR implementation: B acknowledges every packet it receives
+   and buffers those that arrive out of order; A keeps one timer, for
+   the oldest unacknowledged packet, and resends only that packet when
+   it expires
+   - all state lives in a struct sr instance, reached through the
+   protocol table at the end of this file
+   - messages that arrive while the window is full can wait in a
+   backlog (--backlog, backlog.c), as in gbn.c
 **********************************************************************/
 
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
                           MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
+#define SEQSPACE 12     /* the min sequence space for SR must be at least 2 * windowsize */
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
 
+struct sr {
+  /* Sender (A) */
+  struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+  bool acked[WINDOWSIZE];         /* packet in the buffer has been acknowledged */
+  int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
+  int windowcount;                /* the number of packets in the window */
+  int A_nextseqnum;               /* the next sequence number to be used by the sender */
+  double recoverystart;           /* when the current timeout recovery began */
+  bool recovering;                /* a timeout happened and the window has not moved */
+
+  struct backlog backlog;         /* messages waiting for room in the window */
+
+  /* Receiver (B) */
+  int rcvbase;                    /* the first sequence number not yet delivered */
+  struct pkt rcvbuffer[WINDOWSIZE]; /* out-of-order packets, by seqnum % WINDOWSIZE */
+  bool rcvbuffered[WINDOWSIZE];
+  int B_nextseqnum;               /* the sequence number for the next packets sent by B */
+};
+
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
    original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
+   the packet is corrupted.  Which function is used is chosen with --checksum (see
+   checksum.h); the packet is read in place rather than copied.
 */
-int ComputeChecksum(struct pkt packet)
+static int ComputeChecksum(const struct pkt *packet)
 {
-  int checksum = 0;
-  int i;
-
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ )
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
+  return pkt_checksum(packet);
 }
 
-bool IsCorrupted(struct pkt packet)
+static bool IsCorrupted(const struct pkt *packet)
 {
-  if (packet.checksum == ComputeChecksum(packet))
+  if (packet->checksum == ComputeChecksum(packet))
     return (false);
   else
     return (true);
@@ -57,196 +79,228 @@ bool IsCorrupted(struct pkt packet)
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
-
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+/* make a packet of message, put it in the window and send it */
+static void SendNewPacket(struct sr *s, struct msg message)
 {
   struct pkt sendpkt;
   int i;
 
+  /* create packet */
+  sendpkt.seqnum = s->A_nextseqnum;
+  sendpkt.acknum = NOTINUSE;
+  for ( i=0; i<20 ; i++ )
+    sendpkt.payload[i] = message.data[i];
+  sendpkt.checksum = ComputeChecksum(&sendpkt);
+
+  /* put packet in window buffer */
+  s->windowlast = (s->windowlast + 1) % WINDOWSIZE;
+  s->buffer[s->windowlast] = sendpkt;
+  s->acked[s->windowlast] = false;
+  s->windowcount++;
+
+  /* send out packet */
+  if (TRACING(1))
+    printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
+  tolayer3 (A, sendpkt);
+
+  /* start timer if first packet in window */
+  if (s->windowcount == 1)
+    starttimer(A,RTT);
+
+  /* get next sequence number, wrap back to 0 */
+  s->A_nextseqnum = (s->A_nextseqnum + 1) % SEQSPACE;
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void A_output(void *self, struct msg message)
+{
+  struct sr *s = self;
+
   /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
+  if ( s->windowcount < WINDOWSIZE) {
+    if (TRACING(2))
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ )
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE;
-    buffer[windowlast] = sendpkt;
-    windowcount++;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
-
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
-
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
+    SendNewPacket(s, message);
+  }
+  /* window is full, but the message can wait in the backlog */
+  else if (backlog_put(&s->backlog, message) == 0) {
+    if (TRACING(1))
+      printf("----A: New message arrives, send window is full, queue it\n");
   }
   /* if blocked,  window is full */
   else {
-    if (TRACE > 0)
+    if (TRACING(1))
       printf("----A: New message arrives, send window is full\n");
     window_full++;
   }
+  backlog_pressure(&s->backlog, s->windowcount == WINDOWSIZE);
+}
+
+/* move queued messages into the window as far as it has room */
+static void DrainBacklog(struct sr *s)
+{
+  struct msg message;
+
+  while (s->windowcount < WINDOWSIZE && backlog_get(&s->backlog, &message) == 0) {
+    if (TRACING(2))
+      printf("----A: window has room, send queued message to layer3!\n");
+    SendNewPacket(s, message);
+  }
+  backlog_pressure(&s->backlog, s->windowcount == WINDOWSIZE);
 }
 
 
 /* called from layer 3, when a packet arrives for layer 4
    In this practical this will always be an ACK as B never sends data.
 */
-void A_input(struct pkt packet)
+static void A_input(void *self, struct pkt packet)
 {
-  int ackcount = 0;
-  int i;
+  struct sr *s = self;
+  int offset, slot;
 
   /* if received ACK is not corrupted */
-  if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
+  if (!IsCorrupted(&packet)) {
+    if (TRACING(1))
       printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
     total_ACKs_received++;
 
-    /* check if new ACK or duplicate */
-    if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
-          /* check case when seqnum has and hasn't wrapped */
-          if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-              ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
-
-            /* packet is a new ACK */
-            if (TRACE > 0)
-              printf("----A: ACK %d is not a duplicate\n",packet.acknum);
-            new_ACKs++;
-
-            /* cumulative acknowledgement - determine how many packets are ACKed */
-            if (packet.acknum >= seqfirst)
-              ackcount = packet.acknum + 1 - seqfirst;
-            else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
-
-	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
-
-            /* delete the acked packets from window buffer */
-            for (i=0; i<ackcount; i++)
-              windowcount--;
-
-	    /* start timer again if there are still more unacked packets in window */
-            stoptimer(A);
-            if (windowcount > 0)
-              starttimer(A, RTT);
-
-          }
-        }
-        else
-          if (TRACE > 0)
+    /* find the acknowledged packet in the window */
+    offset = (packet.acknum - s->buffer[s->windowfirst].seqnum + SEQSPACE) % SEQSPACE;
+    slot = (s->windowfirst + offset) % WINDOWSIZE;
+    if (s->windowcount == 0 || offset >= s->windowcount || s->acked[slot]) {
+      if (TRACING(1))
         printf ("----A: duplicate ACK received, do nothing!\n");
+      return;
+    }
+
+    /* packet is a new ACK */
+    if (TRACING(1))
+      printf("----A: ACK %d is not a duplicate\n",packet.acknum);
+    new_ACKs++;
+    s->acked[slot] = true;
+
+    /* slide the window past every acknowledged packet at its front */
+    if (offset == 0) {
+      while (s->windowcount > 0 && s->acked[s->windowfirst]) {
+        s->windowfirst = (s->windowfirst + 1) % WINDOWSIZE;
+        s->windowcount--;
+      }
+
+      /* the window moved, so any timeout recovery is over */
+      if (s->recovering) {
+        recoveries++;
+        recovery_time += gettime() - s->recoverystart;
+        s->recovering = false;
+      }
+
+      /* the timer now belongs to the new oldest packet, if any */
+      stoptimer(A);
+      if (s->windowcount > 0)
+        starttimer(A, RTT);
+
+      /* the window moved: send what has been waiting */
+      DrainBacklog(s);
+    }
   }
   else
-    if (TRACE > 0)
+    if (TRACING(1))
       printf ("----A: corrupted ACK is received, do nothing!\n");
 }
 
-/* called when A's timer goes off */
-void A_timerinterrupt(void)
+/* called when A's timer goes off: resend the oldest unacknowledged packet */
+static void A_timerinterrupt(void *self)
 {
-  int i;
+  struct sr *s = self;
 
-  if (TRACE > 0)
+  if (TRACING(1))
     printf("----A: time out,resend packets!\n");
+  if (s->windowcount == 0)
+    return;
 
-  for(i=0; i<windowcount; i++) {
-
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
-
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
+  if (!s->recovering) {
+    s->recovering = true;
+    s->recoverystart = gettime();
   }
+
+  if (TRACING(1))
+    printf ("---A: resending packet %d\n", s->buffer[s->windowfirst].seqnum);
+  tolayer3(A,s->buffer[s->windowfirst]);
+  packets_resent++;
+  starttimer(A,RTT);
 }
 
 
 
 /* the following routine will be called once (only) before any other */
 /* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
+static void A_init(void *self)
 {
+  struct sr *s = self;
+
   /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.
+  s->A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  s->windowfirst = 0;
+  s->windowlast = -1;   /* windowlast is where the last packet sent is stored.
 		     new packets are placed in winlast + 1
 		     so initially this is set to -1
 		   */
-  windowcount = 0;
+  s->windowcount = 0;
+  s->recovering = false;
+
+  backlog_reset(&s->backlog);
 }
 
 
 
 /********* Receiver (B)  variables and procedures ************/
 
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
-
-
 /* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
+static void B_input(void *self, struct pkt packet)
 {
+  struct sr *s = self;
   struct pkt sendpkt;
-  int i;
-
-  /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++;
-
-    /* deliver to receiving application */
-    tolayer5(B, packet.payload);
+  int i, offset;
 
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
-
-    /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+  /* a corrupted packet cannot be acknowledged: A will time out */
+  if (IsCorrupted(&packet)) {
+    if (TRACING(1))
+      printf("----B: packet corrupted, do nothing!\n");
+    return;
   }
-  else {
-    /* packet is corrupted or out of order resend last ACK */
-    if (TRACE > 0)
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
-    else
-      sendpkt.acknum = expectedseqnum - 1;
+
+  offset = (packet.seqnum - s->rcvbase + SEQSPACE) % SEQSPACE;
+  if (offset < WINDOWSIZE) {
+    /* in the receive window: keep it unless we already have it */
+    if (!s->rcvbuffered[packet.seqnum % WINDOWSIZE]) {
+      if (TRACING(1))
+        printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+      packets_received++;
+      s->rcvbuffer[packet.seqnum % WINDOWSIZE] = packet;
+      s->rcvbuffered[packet.seqnum % WINDOWSIZE] = true;
+    }
+
+    /* deliver everything that is now in order */
+    while (s->rcvbuffered[s->rcvbase % WINDOWSIZE]) {
+      tolayer5(B, s->rcvbuffer[s->rcvbase % WINDOWSIZE].payload);
+      s->rcvbuffered[s->rcvbase % WINDOWSIZE] = false;
+      s->rcvbase = (s->rcvbase + 1) % SEQSPACE;
+    }
   }
+  /* anything else is from the previous window: its ACK was lost, so ACK again */
+  else if (TRACING(1))
+    printf("----B: packet %d already delivered, resend ACK!\n",packet.seqnum);
 
   /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
+  sendpkt.seqnum = s->B_nextseqnum;
+  sendpkt.acknum = packet.seqnum;
+  s->B_nextseqnum = (s->B_nextseqnum + 1) % 2;
 
   /* we don't have any data to send.  fill payload with 0's */
   for ( i=0; i<20 ; i++ )
     sendpkt.payload[i] = '0';
 
   /* computer checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt);
+  sendpkt.checksum = ComputeChecksum(&sendpkt);
 
   /* send out packet */
   tolayer3 (B, sendpkt);
@@ -254,10 +308,15 @@ void B_input(struct pkt packet)
 
 /* the following routine will be called once (only) before any other */
 /* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
+static void B_init(void *self)
 {
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
+  struct sr *s = self;
+  int i;
+
+  s->rcvbase = 0;
+  s->B_nextseqnum = 1;
+  for (i=0; i<WINDOWSIZE; i++)
+    s->rcvbuffered[i] = false;
 }
 
 /******************************************************************************
@@ -265,11 +324,44 @@ void B_init(void)
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)
+static void B_output(void *self, struct msg message)
 {
+  (void)self;
+  (void)message;
 }
 
 /* called when B's timer goes off */
-void B_timerinterrupt(void)
+static void B_timerinterrupt(void *self)
 {
+  (void)self;
 }
+
+/******************** protocol table entry ***************************/
+
+static void *sr_create(const struct protoconf *conf)
+{
+  struct sr *s = calloc(1, sizeof(struct sr));
+
+  if (s == NULL) {
+    printf("memory allocation for protocol failed.");
+    exit(EXIT_FAILURE);
+  }
+  backlog_create(&s->backlog, conf);
+  return s;
+}
+
+static void sr_destroy(void *self)
+{
+  struct sr *s = self;
+
+  backlog_destroy(&s->backlog);
+  free(s);
+}
+
+const struct protocol sr_protocol = {
+  "sr", "Selective Repeat",
+  sr_create, sr_destroy,
+  A_init, A_output, A_input, A_timerinterrupt,
+  B_init, B_output, B_input, B_timerinterrupt,
+  PROTO_BACKLOG, 0
+};
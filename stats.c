@@ -0,0 +1,29 @@
+/* ******************************************************************
+   Statistics the protocols update, and the trace level they read.
+   Declared in emulator.h; linked into every front end (emulator, udp,
+   shm), which report them and reset them between runs as they need.
+**********************************************************************/
+#include "emulator.h"
+
+int TRACE = 0;
+
+int window_full;   /* count of the number of messages dropped due to full window */
+int total_ACKs_received;
+int packets_resent;       /* count of the number of packets resent  */
+int new_ACKs;           /* count of the number of acks correctly received */
+int packets_received;  /* count of the packets received by receiver */
+int recoveries;        /* count of timeout recoveries */
+double recovery_time;  /* total time spent in timeout recoveries */
+int messages_queued;   /* count of messages that waited in A's backlog */
+double queue_delay;    /* total time they waited */
+double queue_delay_max;  /* longest wait */
+int backlog_max;       /* longest the backlog has been */
+double backlog_area;   /* backlog length integrated over time */
+int nacks_sent;        /* count of NACKs sent by B */
+int nacks_suppressed;  /* count of gaps not NACKed because one was recent */
+int nack_resends;      /* count of packets resent on a NACK */
+int nack_recoveries;   /* count of recoveries started by a NACK */
+double nack_recovery_time;  /* total time spent in those recoveries */
+int fec_parity_sent;   /* count of FEC parity packets sent by A */
+int fec_rebuilt;       /* count of packets B rebuilt from parity */
+int fec_resends_avoided;  /* of those, the ones A never had to resend */
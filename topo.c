@@ -0,0 +1,222 @@
+/* ******************************************************************
+   Multi-hop topologies for the emulator's medium.  See topo.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "topo.h"
+
+/* the number of node name, added if new; -1 if there are too many */
+static int node(struct topology *t, const char *name)
+{
+  int i;
+
+  for (i = 0; i < t->nnodes; i++)
+    if (strcmp(t->names[i], name) == 0)
+      return i;
+  if (t->nnodes == TOPO_MAXNODES)
+    return -1;
+  strcpy(t->names[t->nnodes], name);
+  return t->nnodes++;
+}
+
+static int addlink(struct topology *t, int from, int to, double rate, double delay,
+                   int capacity, const char *channel)
+{
+  struct link *l;
+
+  if (t->nlinks == TOPO_MAXLINKS)
+    return -1;
+  l = &t->links[t->nlinks++];
+  l->from = from;
+  l->to = to;
+  l->rate = rate;
+  l->delay = delay;
+  l->capacity = capacity;
+  if (*channel != '\0') {
+    if (channel_parse(&l->ch, channel) != 0)
+      return -1;
+    l->channelset = 1;
+  }
+  l->departs = malloc(capacity * sizeof(double));
+  if (l->departs == NULL) {
+    printf("memory allocation for link queue failed.");
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
+
+/* fill t->route with the first links of the shortest paths */
+static void routes(struct topology *t)
+{
+  int queue[TOPO_MAXNODES], seen[TOPO_MAXNODES];
+  int d, i, n, head, tail;
+  struct link *l;
+
+  for (d = 0; d < t->nnodes; d++) {
+    for (n = 0; n < t->nnodes; n++) {
+      t->route[n][d] = -1;
+      seen[n] = 0;
+    }
+    /* breadth first from the destination, against the links */
+    head = tail = 0;
+    queue[tail++] = d;
+    seen[d] = 1;
+    while (head < tail) {
+      n = queue[head++];
+      for (i = 0; i < t->nlinks; i++) {
+        l = &t->links[i];
+        if (l->to == n && !seen[l->from]) {
+          seen[l->from] = 1;
+          t->route[l->from][d] = i;
+          queue[tail++] = l->from;
+        }
+      }
+    }
+  }
+}
+
+int topo_load(struct topology *t, const char *file)
+{
+  FILE *f = fopen(file, "r");
+  char line[256], kind[16], x[16], y[16], extra[128], *hash;
+  double rate, delay, gap;
+  int capacity, n, lineno = 0, from, to, bad = 0;
+  struct cross *c;
+
+  if (f == NULL) {
+    printf("unable to open topology %s\n", file);
+    return -1;
+  }
+  memset(t, 0, sizeof(*t));
+  node(t, "A");
+  node(t, "B");
+  while (!bad && fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    if ((hash = strchr(line, '#')) != NULL)
+      *hash = '\0';
+    extra[0] = '\0';
+    if (sscanf(line, "%15s", kind) != 1)
+      continue;
+    if (strcmp(kind, "link") == 0) {
+      n = sscanf(line, "%*s %15s %15s %lf %lf %d %127s", x, y, &rate, &delay, &capacity, extra);
+      bad = n < 5 || rate < 0.0 || delay < 0.0 || capacity < 1 ||
+        (from = node(t, x)) < 0 || (to = node(t, y)) < 0 || from == to ||
+        addlink(t, from, to, rate, delay, capacity, extra) != 0 ||
+        addlink(t, to, from, rate, delay, capacity, extra) != 0;
+    }
+    else if (strcmp(kind, "cross") == 0) {
+      n = sscanf(line, "%*s %15s %15s %lf %127s", x, y, &gap, extra);
+      bad = n < 3 || gap <= 0.0 || t->ncross == TOPO_MAXCROSS ||
+        (from = node(t, x)) < 0 || (to = node(t, y)) < 0 || from == to;
+      if (!bad) {
+        c = &t->cross[t->ncross++];
+        c->from = from;
+        c->to = to;
+        c->gap = gap;
+        bad = arrival_parse(&c->arr, n == 4 ? extra : "poisson") != 0 ||
+          c->arr.model == ARR_TRACE;
+      }
+    }
+    else
+      bad = 1;
+  }
+  fclose(f);
+  if (bad) {
+    printf("%s:%d: bad topology line\n", file, lineno);
+    return -1;
+  }
+
+  routes(t);
+  if (t->route[TOPO_A][TOPO_B] < 0 || t->route[TOPO_B][TOPO_A] < 0) {
+    printf("%s: no route between A and B\n", file);
+    return -1;
+  }
+  for (n = 0; n < t->ncross; n++)
+    if (t->route[t->cross[n].from][t->cross[n].to] < 0) {
+      printf("%s: no route for cross traffic from %s to %s\n", file,
+             t->names[t->cross[n].from], t->names[t->cross[n].to]);
+      return -1;
+    }
+  return 0;
+}
+
+void topo_start(struct topology *t, double now)
+{
+  struct link *l;
+  struct cross *c;
+  int i;
+
+  for (i = 0; i < t->nlinks; i++) {
+    l = &t->links[i];
+    l->first = l->count = 0;
+    l->packets = l->cross = l->dropped = l->lost = l->corrupted = l->maxqueue = 0;
+    l->waiting = l->busy = 0.0;
+    if (l->channelset)
+      channel_start(&l->ch);
+  }
+  for (i = 0; i < t->ncross; i++) {
+    c = &t->cross[i];
+    c->sent = c->delivered = 0;
+    arrival_start(&c->arr, c->gap, now);
+  }
+}
+
+struct link *topo_route(struct topology *t, int node, int dest)
+{
+  return &t->links[t->route[node][dest]];
+}
+
+double link_send(struct link *l, double now)
+{
+  double start = now, tx = l->rate > 0.0 ? 1.0 / l->rate : 0.0;
+
+  /* packets sent by now have left the queue */
+  while (l->count > 0 && l->departs[l->first] <= now) {
+    l->first = (l->first + 1) % l->capacity;
+    l->count--;
+  }
+  l->packets++;
+  if (l->count == l->capacity) {
+    l->dropped++;
+    return -1.0;
+  }
+  if (l->count > 0)
+    start = l->departs[(l->first + l->count - 1) % l->capacity];
+  l->waiting += start - now;
+  l->busy += tx;
+  l->departs[(l->first + l->count++) % l->capacity] = start + tx;
+  if (l->count > l->maxqueue)
+    l->maxqueue = l->count;
+  return start + tx + l->delay;
+}
+
+void topo_report(struct topology *t, double now)
+{
+  struct link *l;
+  struct cross *c;
+  int i, sent;
+
+  for (i = 0; i < t->nlinks; i++) {
+    l = &t->links[i];
+    sent = l->packets - l->dropped;
+    printf("link %s->%s (rate ", t->names[l->from], t->names[l->to]);
+    if (l->rate > 0.0)
+      printf("%g", l->rate);
+    else
+      printf("unlimited");
+    printf(", delay %g, queue %d%s%s): %d packets (%d cross traffic)\n", l->delay, l->capacity,
+           l->channelset ? ", " : "", l->channelset ? l->ch.name : "", l->packets, l->cross);
+    if (l->packets == 0)
+      continue;
+    printf("    %d dropped at the queue, %d lost, %d corrupted, longest queue %d, mean wait %f, utilisation %.1f%%\n",
+           l->dropped, l->lost, l->corrupted, l->maxqueue, sent ? l->waiting / sent : 0.0,
+           now > 0 ? 100.0 * l->busy / now : 0.0);
+  }
+  for (i = 0; i < t->ncross; i++) {
+    c = &t->cross[i];
+    printf("cross traffic %s->%s (%s, mean gap %g): %d packets sent, %d delivered\n",
+           t->names[c->from], t->names[c->to], arrival_name(&c->arr), c->gap, c->sent, c->delivered);
+  }
+}
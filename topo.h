@@ -0,0 +1,101 @@
+#ifndef TOPO_H
+#define TOPO_H
+
+/* ******************************************************************
+   Multi-hop topologies for the emulator's medium.
+
+   With --topology=FILE, A and B are two nodes of a network of routers
+   joined by links instead of the ends of a single channel.  Packets
+   are forwarded hop by hop along the shortest path (fewest hops), and
+   every hop is an event.  Each direction of a link has a transmission
+   rate, a propagation delay, a drop-tail queue and optionally a loss
+   and corruption model.  Cross-traffic sources inject packets between
+   routers that compete with A and B's packets for the queues.
+
+   The file has one item per line, # starts a comment:
+
+     link X Y RATE DELAY QUEUE [CHANNEL]
+         a link in both directions between nodes X and Y.  RATE is in
+         packets per time unit (0 for no limit), QUEUE the most packets
+         waiting or being sent on it, CHANNEL a channel.h model (no
+         losses without one)
+     cross X Y GAP [ARRIVAL]
+         a cross-traffic source at X sending to Y with a mean time GAP
+         between packets, distributed as the arrival.h model ARRIVAL
+         (default poisson)
+
+   Nodes are named by the links; A and B must be among them.
+**********************************************************************/
+
+#include "arrival.h"
+#include "channel.h"
+
+#define TOPO_MAXNODES 16
+#define TOPO_MAXLINKS 64    /* each direction of a link counts */
+#define TOPO_MAXCROSS 8
+
+/* one direction of a link */
+struct link {
+  int from, to;
+  double rate;              /* packets per time unit, 0 for no limit */
+  double delay;
+  int capacity;             /* packets queued or being sent */
+  int channelset;
+  struct channel ch;
+
+  double *departs;          /* when each queued packet has been sent, */
+  int first, count;         /* in a ring of capacity entries */
+
+  /* statistics */
+  int packets;              /* packets offered to the link */
+  int cross;                /* of which cross traffic */
+  int dropped;              /* found the queue full */
+  int lost;                 /* lost on the wire */
+  int corrupted;            /* corrupted on the wire (cross traffic is
+                               counted but has no payload to damage) */
+  int maxqueue;
+  double waiting;           /* total time packets waited in the queue */
+  double busy;              /* total time spent sending */
+};
+
+struct cross {
+  int from, to;
+  double gap;               /* mean time between packets */
+  struct arrival arr;
+
+  /* statistics */
+  int sent;
+  int delivered;
+};
+
+struct topology {
+  int nnodes;
+  char names[TOPO_MAXNODES][16];
+  int nlinks;
+  struct link links[TOPO_MAXLINKS];
+  int route[TOPO_MAXNODES][TOPO_MAXNODES];  /* link out of node i toward node j */
+  int ncross;
+  struct cross cross[TOPO_MAXCROSS];
+};
+
+/* node numbers of the endpoints */
+#define TOPO_A 0
+#define TOPO_B 1
+
+/* read FILE into t; returns 0 on success */
+extern int topo_load(struct topology *t, const char *file);
+
+/* empty t's queues and reset its statistics and cross traffic at now */
+extern void topo_start(struct topology *t, double now);
+
+/* the link a packet at node takes toward dest */
+extern struct link *topo_route(struct topology *t, int node, int dest);
+
+/* a packet is offered to l at now: returns when it reaches l->to, or
+   -1 if l's queue is full */
+extern double link_send(struct link *l, double now);
+
+/* print the statistics of every link and cross-traffic source */
+extern void topo_report(struct topology *t, double now);
+
+#endif
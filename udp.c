@@ -0,0 +1,697 @@
+/* ******************************************************************
+   Loopback UDP runtime for the transport protocols.
+
+   Runs a protocol from the registry over two real UDP sockets on
+   127.0.0.1, one for A and one for B, instead of the emulated medium.
+   It provides the same tolayer3/tolayer5/starttimer/stoptimer contract
+   as emulator.c:
+   - timers are timerfds, one per entity, in real time: one protocol
+     time unit is --unit microseconds (default 1000, so RTT 16.0 is
+     16 ms)
+   - everything is driven by one epoll loop; packets given to tolayer3
+     are collected and sent with one sendmmsg() per socket and loop
+     iteration, and received with recvmmsg()
+   - an optional in-process shim on the sending side loses, corrupts
+     (with the emulator's channel models) and delays packets; delayed
+     packets keep their order and are released by a timerfd
+   - layer 5 at A offers a message every --interval microseconds
+
+   At the end it reports packets per second, message latency from
+   A_output to B's tolayer5 and the CPU time spent per packet, in total
+   and inside the protocol's own callbacks.
+
+   Linux only.  Build with
+     gcc -O2 -o udp udp.c gbn.c sr.c protocol.c stats.c channel.c fec.c backlog.c checksum.c instrument.c -lm
+**********************************************************************/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include "emulator.h"
+#include "protocol.h"
+#include "channel.h"
+#include "checksum.h"
+
+#define BATCH      64         /* packets per sendmmsg/recvmmsg */
+#define WIRESIZE   32         /* seqnum, acknum, checksum, payload */
+#define DELAYQ     4096       /* packets the shim can hold per direction */
+
+/* epoll tags */
+#define TAG_SOCK   0          /* + A or B */
+#define TAG_TIMER  2          /* + A or B */
+#define TAG_GEN    4
+#define TAG_SHIM   5
+
+static const struct protocol *proto;
+static void *instance;
+static struct protoconf conf;
+
+static int sock[2];
+static int timerfd[2];
+static int timerarmed[2];
+static int genfd, shimfd, epfd;
+
+static long unit_us = 1000;     /* microseconds per protocol time unit */
+static long interval_us = 100;  /* between messages from layer 5 */
+static int nsimmax = 100000;
+static double delay_us, jitter_us;
+static unsigned seed = 9999;
+static struct channel channels[2];
+
+static uint64_t start_ns;
+static int nsim;                /* messages offered by layer 5 */
+static int paused;
+
+/* packets waiting for the next sendmmsg, per sending entity */
+static unsigned char outbuf[2][BATCH][WIRESIZE];
+static int outcount[2];
+
+/* packets held back by the delay shim, oldest first */
+struct delayed {
+  uint64_t release;
+  unsigned char wire[WIRESIZE];
+};
+static struct delayed delayq[2][DELAYQ];
+static int delayfirst[2], delaycount[2];
+static uint64_t lastrelease[2];
+
+/* when each undelivered message was accepted, oldest first */
+static uint64_t *accepted;
+static int acceptfirst, acceptcount;
+
+/* statistics */
+static long sent[2], received[2], shimlost[2], shimcorrupt[2], shimdrop[2], kerneldrop[2];
+static long sendcalls, recvcalls;
+static long delivered;
+static double latencysum, latencymax;
+static uint64_t callback_ns;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+double jimsrand(void)
+{
+  return rand() / (double)RAND_MAX;
+}
+
+double gettime(void)
+{
+  return (now_ns() - start_ns) / (1000.0 * unit_us);
+}
+
+static void encode(const struct pkt *p, unsigned char *w)
+{
+  uint32_t v[3];
+
+  v[0] = htonl((uint32_t)p->seqnum);
+  v[1] = htonl((uint32_t)p->acknum);
+  v[2] = htonl((uint32_t)p->checksum);
+  memcpy(w, v, sizeof(v));
+  memcpy(w + sizeof(v), p->payload, 20);
+}
+
+static void decode(const unsigned char *w, struct pkt *p)
+{
+  uint32_t v[3];
+
+  memcpy(v, w, sizeof(v));
+  p->seqnum = (int)ntohl(v[0]);
+  p->acknum = (int)ntohl(v[1]);
+  p->checksum = (int)ntohl(v[2]);
+  memcpy(p->payload, w + sizeof(v), 20);
+}
+
+static void settimer(int fd, uint64_t ns, int absolute)
+{
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = ns / 1000000000u;
+  its.it_value.tv_nsec = ns % 1000000000u;
+  if (timerfd_settime(fd, absolute ? TFD_TIMER_ABSTIME : 0, &its, NULL) != 0) {
+    perror("timerfd_settime");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void flush(int AorB)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iov[BATCH];
+  int i, n, done = 0;
+
+  if (outcount[AorB] == 0)
+    return;
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < outcount[AorB]; i++) {
+    iov[i].iov_base = outbuf[AorB][i];
+    iov[i].iov_len = WIRESIZE;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  while (done < outcount[AorB]) {
+    n = sendmmsg(sock[AorB], msgs + done, outcount[AorB] - done, 0);
+    sendcalls++;
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      /* socket buffer full (or the peer went away): the kernel lost them */
+      kerneldrop[AorB] += outcount[AorB] - done;
+      break;
+    }
+    sent[AorB] += n;
+    done += n;
+  }
+  outcount[AorB] = 0;
+}
+
+static void enqueue(int AorB, const unsigned char *wire)
+{
+  if (outcount[AorB] == BATCH)
+    flush(AorB);
+  memcpy(outbuf[AorB][outcount[AorB]++], wire, WIRESIZE);
+}
+
+/* arm the shim timer for the earliest held packet in either direction */
+static void armshim(void)
+{
+  uint64_t t = 0;
+  int i;
+
+  for (i = A; i <= B; i++)
+    if (delaycount[i] > 0 && (t == 0 || delayq[i][delayfirst[i]].release < t))
+      t = delayq[i][delayfirst[i]].release;
+  settimer(shimfd, t, 1);     /* 0 disarms */
+}
+
+static void releasedelayed(void)
+{
+  uint64_t now = now_ns();
+  struct delayed *d;
+  int i;
+
+  for (i = A; i <= B; i++)
+    while (delaycount[i] > 0 && (d = &delayq[i][delayfirst[i]])->release <= now) {
+      enqueue(i, d->wire);
+      delayfirst[i] = (delayfirst[i] + 1) % DELAYQ;
+      delaycount[i]--;
+    }
+  armshim();
+}
+
+/********************** protocol-callable routines ***********************/
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  unsigned char wire[WIRESIZE];
+  struct delayed *d;
+  double x;
+  uint64_t release;
+
+  if (channel_lose(&channels[AorB])) {
+    shimlost[AorB]++;
+    if (TRACING(1))
+      printf("          TOLAYER3: packet being lost\n");
+    return;
+  }
+  if (channel_corrupt(&channels[AorB])) {
+    shimcorrupt[AorB]++;
+    if ((x = jimsrand()) < .75)
+      packet.payload[0] = 'Z';
+    else if (x < .875)
+      packet.seqnum = 999999;
+    else
+      packet.acknum = 999999;
+    if (TRACING(1))
+      printf("          TOLAYER3: packet being corrupted\n");
+  }
+  encode(&packet, wire);
+
+  if (channel_delay(&channels[AorB], &x))   /* a trace: its delay, in time units */
+    x *= unit_us;
+  else if (delay_us > 0.0 || jitter_us > 0.0)
+    x = delay_us + jitter_us * jimsrand();
+  else
+    x = 0.0;
+  if (x <= 0.0 && delaycount[AorB] == 0) {
+    enqueue(AorB, wire);
+    return;
+  }
+  if (delaycount[AorB] == DELAYQ) {
+    shimdrop[AorB]++;
+    return;
+  }
+  /* the medium does not reorder: never release before the previous one */
+  release = now_ns() + (uint64_t)(1000.0 * x);
+  if (release < lastrelease[AorB])
+    release = lastrelease[AorB];
+  lastrelease[AorB] = release;
+  d = &delayq[AorB][(delayfirst[AorB] + delaycount[AorB]++) % DELAYQ];
+  d->release = release;
+  memcpy(d->wire, wire, WIRESIZE);
+  if (delaycount[AorB] == 1)
+    armshim();
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  double lat;
+
+  if (TRACING(3))
+    printf("          TOLAYER5: data received by application at %c: %.20s\n",
+           AorB == A ? 'A' : 'B', datasent);
+  delivered++;
+  if (acceptcount > 0) {
+    lat = (now_ns() - accepted[acceptfirst]) / 1000.0;
+    latencysum += lat;
+    if (lat > latencymax)
+      latencymax = lat;
+    acceptfirst = (acceptfirst + 1) % nsimmax;
+    acceptcount--;
+  }
+}
+
+void starttimer(int AorB, double increment)
+{
+  if (timerarmed[AorB]) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  settimer(timerfd[AorB], (uint64_t)(increment * unit_us * 1000.0), 0);
+  timerarmed[AorB] = 1;
+}
+
+void stoptimer(int AorB)
+{
+  if (!timerarmed[AorB]) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  settimer(timerfd[AorB], 0, 0);
+  timerarmed[AorB] = 0;
+}
+
+static void startgen(void)
+{
+  struct itimerspec its;
+
+  its.it_value.tv_sec = 0;
+  its.it_value.tv_nsec = 1;             /* first message straight away */
+  its.it_interval.tv_sec = interval_us / 1000000;
+  its.it_interval.tv_nsec = interval_us % 1000000 * 1000;
+  timerfd_settime(genfd, 0, &its, NULL);
+}
+
+void stoplayer5(int AorB)
+{
+  if (AorB != A || paused)
+    return;
+  paused = 1;
+  settimer(genfd, 0, 0);
+}
+
+void startlayer5(int AorB)
+{
+  if (AorB != A || !paused)
+    return;
+  paused = 0;
+  if (nsim < nsimmax)
+    startgen();
+}
+
+/************************** event loop *******************************/
+
+static void offer(void)
+{
+  struct msg m;
+  int dropped = window_full;
+  uint64_t t = now_ns(), t0;
+
+  memset(m.data, 'a' + nsim % 26, 20);
+  nsim++;
+  t0 = now_ns();
+  proto->A_output(instance, m);
+  callback_ns += now_ns() - t0;
+  if (window_full == dropped) {
+    accepted[(acceptfirst + acceptcount++) % nsimmax] = t;
+  }
+  if (nsim == nsimmax)
+    settimer(genfd, 0, 0);
+}
+
+static void readsocket(int AorB)
+{
+  struct mmsghdr msgs[BATCH];
+  struct iovec iov[BATCH];
+  unsigned char buf[BATCH][WIRESIZE];
+  struct pkt p;
+  uint64_t t0;
+  int i, n;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < BATCH; i++) {
+    iov[i].iov_base = buf[i];
+    iov[i].iov_len = WIRESIZE;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  do {
+    n = recvmmsg(sock[AorB], msgs, BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+      return;
+    recvcalls++;
+    received[AorB] += n;
+    for (i = 0; i < n; i++) {
+      if (msgs[i].msg_len != WIRESIZE)
+        continue;
+      decode(buf[i], &p);
+      t0 = now_ns();
+      if (AorB == A)
+        proto->A_input(instance, p);
+      else
+        proto->B_input(instance, p);
+      callback_ns += now_ns() - t0;
+    }
+  } while (n == BATCH);
+}
+
+static int expired(int fd)
+{
+  uint64_t n;
+
+  if (read(fd, &n, sizeof(n)) != sizeof(n))
+    return 0;
+  return (int)n;
+}
+
+static void watch(int fd, int tag)
+{
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    perror("epoll_ctl");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void opensockets(void)
+{
+  struct sockaddr_in addr[2];
+  socklen_t len = sizeof(struct sockaddr_in);
+  int i, size = 4 << 20;
+
+  for (i = A; i <= B; i++) {
+    sock[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (sock[i] < 0) {
+      perror("socket");
+      exit(EXIT_FAILURE);
+    }
+    setsockopt(sock[i], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(sock[i], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    memset(&addr[i], 0, sizeof(addr[i]));
+    addr[i].sin_family = AF_INET;
+    addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock[i], (struct sockaddr *)&addr[i], len) != 0 ||
+        getsockname(sock[i], (struct sockaddr *)&addr[i], &len) != 0) {
+      perror("bind");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (i = A; i <= B; i++)
+    if (connect(sock[i], (struct sockaddr *)&addr[(i+1) % 2], len) != 0) {
+      perror("connect");
+      exit(EXIT_FAILURE);
+    }
+}
+
+static void usage(const char *prog)
+{
+  int i;
+
+  printf("usage: %s [options]\n", prog);
+  printf("  --protocol=NAME          transport protocol (default gbn):\n");
+  for (i = 0; protocols[i] != NULL; i++)
+    printf("                             %-10s %s\n", protocols[i]->name, protocols[i]->description);
+  printf("  --messages=N             messages to send (default 100000)\n");
+  printf("  --interval=USEC          time between messages from layer 5 (default 100)\n");
+  printf("  --unit=USEC              length of one protocol time unit (default 1000)\n");
+  printf("  --channel=SPEC           shim loss/corruption model for both directions\n");
+  printf("  --channel-ab=SPEC        model for A->B only\n");
+  printf("  --channel-ba=SPEC        model for B->A only\n");
+  printf("                           (see the emulator; default no impairment); a\n");
+  printf("                           trace also gives each packet's delay\n");
+  printf("  --delay=USEC[,JITTER]    shim one-way delay, plus up to JITTER\n");
+  printf("  --sack                   selective acknowledgements (gbn only)\n");
+  printf("  --checksum=NAME          packet checksum: sum (default), crc32c or inet\n");
+  printf("  --backlog=N[,tail|block] queue up to N messages at A while the window is full\n");
+  printf("  --seed=N                 random seed for the shim (default 9999)\n");
+  printf("  --trace=N                protocol trace level (default 0)\n");
+  printf("  --help                   show this message\n");
+}
+
+static void parseargs(int argc, char **argv)
+{
+  static const struct option longopts[] = {
+    { "protocol",   required_argument, NULL, 'p' },
+    { "messages",   required_argument, NULL, 'n' },
+    { "interval",   required_argument, NULL, 'i' },
+    { "unit",       required_argument, NULL, 'u' },
+    { "channel",    required_argument, NULL, 'c' },
+    { "channel-ab", required_argument, NULL, '0' },
+    { "channel-ba", required_argument, NULL, '1' },
+    { "delay",      required_argument, NULL, 'd' },
+    { "sack",       no_argument,       NULL, 's' },
+    { "checksum",   required_argument, NULL, 'k' },
+    { "backlog",    required_argument, NULL, 'b' },
+    { "seed",       required_argument, NULL, 'S' },
+    { "trace",      required_argument, NULL, 't' },
+    { "help",       no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  char policy[8];
+  int c, i;
+
+  proto = findprotocol("gbn");
+  for (i = A; i <= B; i++)
+    channel_bernoulli(&channels[i], 0.0, 0.0);
+  while ((c = getopt_long(argc, argv, "h", longopts, NULL)) != -1) {
+    switch (c) {
+    case 'p':
+      if ((proto = findprotocol(optarg)) == NULL) {
+        printf("unknown protocol: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'n':
+      if (sscanf(optarg, "%d", &nsimmax) != 1 || nsimmax < 1) {
+        printf("bad message count: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'i':
+      if (sscanf(optarg, "%ld", &interval_us) != 1 || interval_us < 1) {
+        printf("bad interval: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'u':
+      if (sscanf(optarg, "%ld", &unit_us) != 1 || unit_us < 1) {
+        printf("bad time unit: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'c':
+    case '0':
+    case '1':
+      for (i = A; i <= B; i++)
+        if ((c == 'c' || c == '0' + i) && channel_parse(&channels[i], optarg) != 0) {
+          printf("bad channel model: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      break;
+    case 'd':
+      if (sscanf(optarg, "%lf,%lf", &delay_us, &jitter_us) < 1 || delay_us < 0.0 || jitter_us < 0.0) {
+        printf("bad delay: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 's':
+      conf.sack = 1;
+      break;
+    case 'b':
+      strcpy(policy, "tail");
+      if (sscanf(optarg, "%d,%7s", &conf.backlog_capacity, policy) < 1 || conf.backlog_capacity < 0 ||
+          (strcmp(policy, "tail") != 0 && strcmp(policy, "block") != 0)) {
+        printf("bad backlog: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      conf.backlog_block = strcmp(policy, "block") == 0;
+      break;
+    case 'k':
+      if ((checksum_kind = checksum_parse(optarg)) < 0) {
+        printf("unknown checksum: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'S':
+      if (sscanf(optarg, "%u", &seed) != 1) {
+        printf("bad seed: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 't':
+      TRACE = atoi(optarg);
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void report(double elapsed)
+{
+  struct rusage ru;
+  double cpu;
+  long packets = sent[A] + sent[B];
+  int i;
+
+  getrusage(RUSAGE_SELF, &ru);
+  cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+        (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+
+  printf("udp loopback, %s: %d messages offered, %d refused (window full), %ld delivered in %.3f s\n",
+         proto->name, nsim, window_full, delivered, elapsed);
+  printf("number of packet resends by A:  %d, timeout recoveries:  %d\n", packets_resent, recoveries);
+  if (nacks_sent > 0)
+    printf("NACKs sent by B:  %d (%d suppressed), packets resent on a NACK:  %d, NACK recoveries:  %d\n",
+           nacks_sent, nacks_suppressed, nack_resends, nack_recoveries);
+  for (i = A; i <= B; i++)
+    printf("%s: %ld packets sent, %ld received; shim lost %ld, corrupted %ld, overflowed %ld; kernel dropped %ld\n",
+           i == A ? "A->B" : "B->A", sent[i], received[(i+1) % 2], shimlost[i], shimcorrupt[i],
+           shimdrop[i], kerneldrop[i]);
+  if (fec_parity_sent > 0)
+    printf("FEC parity packets sent by A:  %d, packets rebuilt at B:  %d, retransmissions avoided:  %d\n",
+           fec_parity_sent, fec_rebuilt, fec_resends_avoided);
+  printf("throughput: %.0f packets/s, %.0f messages/s\n",
+         packets / elapsed, delivered / elapsed);
+  printf("batching: %ld sendmmsg calls (%.1f packets each), %ld recvmmsg calls (%.1f packets each)\n",
+         sendcalls, sendcalls ? (double)packets / sendcalls : 0.0,
+         recvcalls, recvcalls ? (double)(received[A] + received[B]) / recvcalls : 0.0);
+  printf("message latency: mean %.1f us, max %.1f us\n",
+         delivered ? latencysum / delivered : 0.0, latencymax);
+  printf("cpu: %.3f s (%.0f%% of wall time), %.2f us per packet; %.2f us per packet in protocol callbacks\n",
+         cpu, 100.0 * cpu / elapsed, packets ? 1e6 * cpu / packets : 0.0,
+         packets ? callback_ns / 1000.0 / packets : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+  struct epoll_event evs[16];
+  int idle;
+  int i, n, k, tag;
+
+  parseargs(argc, argv);
+  if (protocol_check(proto, &conf) != 0)
+    exit(EXIT_FAILURE);
+  srand(seed);
+  for (i = A; i <= B; i++)
+    channel_start(&channels[i]);
+  accepted = malloc(nsimmax * sizeof(uint64_t));
+  if (accepted == NULL) {
+    printf("memory allocation for message times failed.");
+    exit(EXIT_FAILURE);
+  }
+
+  opensockets();
+  epfd = epoll_create1(0);
+  for (i = A; i <= B; i++) {
+    timerfd[i] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    watch(sock[i], TAG_SOCK + i);
+    watch(timerfd[i], TAG_TIMER + i);
+  }
+  genfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  shimfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  watch(genfd, TAG_GEN);
+  watch(shimfd, TAG_SHIM);
+
+  instance = proto->create(&conf);
+  start_ns = now_ns();
+  proto->A_init(instance);
+  proto->B_init(instance);
+  startgen();
+
+  /* until everything accepted is delivered, or nothing happens for 2 s */
+  idle = 0;
+  while (nsim < nsimmax || acceptcount > 0) {
+    n = epoll_wait(epfd, evs, 16, 1000);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      if (++idle == 2) {
+        printf("no progress for 2 s, giving up with %d messages undelivered\n", acceptcount);
+        break;
+      }
+      continue;
+    }
+    idle = 0;
+    for (i = 0; i < n; i++) {
+      tag = evs[i].data.u32;
+      switch (tag) {
+      case TAG_SOCK + A:
+      case TAG_SOCK + B:
+        readsocket(tag - TAG_SOCK);
+        break;
+      case TAG_TIMER + A:
+      case TAG_TIMER + B:
+        if (expired(timerfd[tag - TAG_TIMER]) > 0 && timerarmed[tag - TAG_TIMER]) {
+          uint64_t t0 = now_ns();
+
+          timerarmed[tag - TAG_TIMER] = 0;
+          if (tag == TAG_TIMER + A)
+            proto->A_timerinterrupt(instance);
+          else
+            proto->B_timerinterrupt(instance);
+          callback_ns += now_ns() - t0;
+        }
+        break;
+      case TAG_GEN:
+        /* catch up on ticks we were too busy to see */
+        for (k = expired(genfd); k > 0 && nsim < nsimmax && !paused; k--)
+          offer();
+        break;
+      case TAG_SHIM:
+        expired(shimfd);
+        releasedelayed();
+        break;
+      }
+    }
+    flush(A);
+    flush(B);
+  }
+
+  report((now_ns() - start_ns) / 1e9);
+  proto->destroy(instance);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+/* ******************************************************************
+   File transfer workload for the emulator.  See xfer.h.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xfer.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+static uint64_t fnv(uint64_t h, const unsigned char *p, size_t n)
+{
+  while (n-- > 0)
+    h = (h ^ *p++) * FNV_PRIME;
+  return h;
+}
+
+int xfer_open(struct xfer *x, const char *spec)
+{
+  struct stat st;
+  char *comma;
+  void *map;
+  int fd;
+
+  memset(x, 0, sizeof(*x));
+  x->fd = -1;
+  x->in = strdup(spec);
+  if ((comma = strchr(x->in, ',')) != NULL) {
+    *comma = '\0';
+    x->out = comma + 1;
+  }
+  if ((fd = open(x->in, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    printf("unable to open %s: %s\n", x->in, strerror(errno));
+    return -1;
+  }
+  if (st.st_size == 0) {
+    printf("%s is empty\n", x->in);
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    printf("unable to map %s: %s\n", x->in, strerror(errno));
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  x->map = map;
+  x->size = st.st_size;
+  x->nmsgs = (x->size + 19) / 20;
+  x->insum = fnv(FNV_OFFSET, x->map, x->size);
+  x->buf = malloc(XFER_BUFSIZE);
+  if (x->buf == NULL) {
+    printf("memory allocation for file buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
+
+void xfer_start(struct xfer *x)
+{
+  x->next = x->delivered = x->bad = 0;
+  x->outsum = FNV_OFFSET;
+  x->buffered = x->written = 0;
+  if (x->out == NULL)
+    return;
+  if (x->fd >= 0)
+    close(x->fd);
+  x->fd = open(x->out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (x->fd < 0) {
+    printf("unable to create %s: %s\n", x->out, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+int xfer_more(const struct xfer *x)
+{
+  return x->next < x->nmsgs;
+}
+
+/* bytes of IN in message i */
+static size_t msglen(const struct xfer *x, long i)
+{
+  size_t off = (size_t)i * 20;
+
+  return off + 20 <= x->size ? 20 : x->size - off;
+}
+
+void xfer_message(const struct xfer *x, char data[20])
+{
+  size_t n = msglen(x, x->next);
+
+  memcpy(data, x->map + (size_t)x->next * 20, n);
+  memset(data + n, 0, 20 - n);
+}
+
+void xfer_accepted(struct xfer *x)
+{
+  x->next++;
+}
+
+static void flush(struct xfer *x)
+{
+  const unsigned char *p = x->buf;
+  ssize_t n;
+
+  while (x->buffered > 0) {
+    n = write(x->fd, p, x->buffered);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      printf("write to %s failed: %s\n", x->out, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    p += n;
+    x->buffered -= n;
+  }
+}
+
+void xfer_deliver(struct xfer *x, const char data[20])
+{
+  size_t n = 20;
+
+  if (x->delivered < x->nmsgs) {
+    n = msglen(x, x->delivered);
+    if (memcmp(data, x->map + (size_t)x->delivered * 20, n) != 0)
+      x->bad++;
+  }
+  else
+    x->bad++;           /* more than was sent */
+  x->delivered++;
+  x->outsum = fnv(x->outsum, (const unsigned char *)data, n);
+  x->written += n;
+  if (x->fd < 0)
+    return;
+  if (x->buffered + n > XFER_BUFSIZE)
+    flush(x);
+  memcpy(x->buf + x->buffered, data, n);
+  x->buffered += n;
+}
+
+void xfer_finish(struct xfer *x)
+{
+  if (x->fd >= 0)
+    flush(x);
+}
+
+void xfer_report(const struct xfer *x, double simtime, double wall)
+{
+  int ok = x->written == x->size && x->outsum == x->insum && x->bad == 0;
+
+  printf("file transfer %s: %zu bytes in %ld messages, delivered %zu bytes in %ld messages%s%s\n",
+         x->in, x->size, x->nmsgs, x->written, x->delivered, x->out ? " to " : "",
+         x->out ? x->out : "");
+  printf("    checksum sent %016llx, delivered %016llx: %s", (unsigned long long)x->insum,
+         (unsigned long long)x->outsum, ok ? "OK" : "MISMATCH");
+  if (x->bad > 0)
+    printf(" (%ld messages not what was sent there)", x->bad);
+  printf("\n");
+  printf("    simulated goodput %g MB/s (a time unit taken as a second), %g MB/s of wall-clock time\n",
+         simtime > 0 ? x->written / simtime / 1e6 : 0.0, wall > 0 ? x->written / wall / 1e6 : 0.0);
+}
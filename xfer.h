@@ -0,0 +1,65 @@
+#ifndef XFER_H
+#define XFER_H
+
+/* ******************************************************************
+   File transfer workload.
+
+   With --file=IN[,OUT] layer 5 at A sends the contents of IN, 20 bytes
+   per message (the last one padded with zeros), instead of messages of
+   repeated letters, and layer 5 at B writes what it is given to OUT.
+   IN is mapped into memory; OUT is written through a large buffer.  A
+   message the protocol refuses is offered again with the next arrival,
+   so the whole file is sent.  Every message delivered is compared with
+   the part of IN it should be, and a checksum (64 bit FNV-1a) of the
+   delivered stream is compared with that of IN at the end.
+**********************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define XFER_BUFSIZE (1 << 20)
+
+struct xfer {
+  char *in;                 /* file names; out may be NULL */
+  char *out;
+  const unsigned char *map; /* IN, mapped */
+  size_t size;
+  uint64_t insum;           /* checksum of IN */
+  long nmsgs;               /* messages IN makes */
+
+  long next;                /* message to offer next */
+  long delivered;           /* messages delivered */
+  long bad;                 /* of which not what was sent in that place */
+  uint64_t outsum;          /* checksum of what was delivered */
+  int fd;                   /* OUT */
+  unsigned char *buf;
+  size_t buffered;
+  size_t written;           /* bytes delivered */
+};
+
+/* parse IN[,OUT] and map IN; returns 0 on success */
+extern int xfer_open(struct xfer *x, const char *spec);
+
+/* start sending from the beginning, and (re)create OUT */
+extern void xfer_start(struct xfer *x);
+
+/* 1 while part of IN has not been accepted by layer 4 */
+extern int xfer_more(const struct xfer *x);
+
+/* fill data with the message to offer next */
+extern void xfer_message(const struct xfer *x, char data[20]);
+
+/* layer 4 accepted that message */
+extern void xfer_accepted(struct xfer *x);
+
+/* layer 5 at the receiver was given data */
+extern void xfer_deliver(struct xfer *x, const char data[20]);
+
+/* write out what is still buffered */
+extern void xfer_finish(struct xfer *x);
+
+/* print the outcome; simtime and wall are the run's simulated and
+   wall-clock duration */
+extern void xfer_report(const struct xfer *x, double simtime, double wall);
+
+#endif